@@ -0,0 +1,84 @@
+/* Per-second audio excitement features of a whole match, streamed from its WAV file.         */
+
+/* audio_features.m needs the audio pre-split into MP3 chunks and holds each chunk in memory to
+ * filter and threshold it. This MEX streams the file one second at a time (audio_stream.h), so
+ * the memory used does not depend on the length of the match, and returns one record per second
+ * keyed by the video second, the time base of proesmans_batch (T), sb_lookup and sb_evaluate,
+ * so that the audio cues can be joined to the motion and scorebox ones directly.             */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex audio_stream.cpp
+ * then try it as follows:
+   system('ffmpeg -i vid52.mp4 -vn -acodec pcm_s16le vid52.wav');   % as in convert_audio.m
+   R=audio_stream('vid52.wav');                        % one row per second of audio
+   R=audio_stream('vid52.wav',1,600);                  % first second is second 1, 600 s window
+   stem(R(:,1),R(:,2));                                % the event signal of audio_features.m
+ * R has one row per second (the last one possibly partial) with the columns:
+ *    1 video second t0+k of the k-th second of audio, k from 0 (default t0 = 1, so that the
+ *      first second is second 1, as in signal_t1 and in the Time of the ScoreBox JSON)
+ *    2 1 if the band-passed envelope exceeds the threshold in this second (signal_t1)
+ *    3 fraction of the samples of the second above the threshold
+ *    4 change of column 2 from the previous second: 1 excitement starts, -1 it ends
+ *    5 RMS of the band-passed signal
+ *    6 mean and 7 peak of the band-passed envelope (|L|+|R|)/2
+ *    8 threshold used, max - mean of the raw envelope over the last window seconds (default 600,
+ *      about the length of the chunks audio_features.m was run on)                            */
+
+#include "mex.h"
+#include <vector>
+#include "audio_stream.h"
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    as_stream s;
+    std::vector<double> records;
+    double rec[AS_NCOLS], t0, *R;
+    int window, col;
+    size_t k, K;
+    char *name;
+
+    /* Check for proper number of arguments */
+    if (nrhs < 1 || nrhs > 3) {
+        mexErrMsgTxt("usage: R=audio_stream(wav_file,t0,window);");
+    } else if (nlhs > 1) {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    if (!mxIsChar(prhs[0]))
+        mexErrMsgTxt("usage: R=audio_stream(wav_file,t0,window); \n wav_file must be a file name");
+
+    t0 = (nrhs > 1 ? mxGetScalar(prhs[1]) : 1);
+    window = (nrhs > 2 ? (int) mxGetScalar(prhs[2]) : 600);
+
+    name = mxArrayToString(prhs[0]);
+    if (as_open(name, &s, window) != 0) {
+        mxFree(name);
+        mexErrMsgTxt("audio_stream: cannot open the file, or it is not a 16/24/32 bit PCM or float WAV file");
+    }
+    mxFree(name);
+
+    /* do the actual computations ************************************************************* */
+
+    while (as_next(&s, rec)) {
+        rec[0] += t0;
+        records.insert(records.end(), rec, rec + AS_NCOLS);
+    }
+    as_close(&s);
+
+    /* deal with OUTPUT parameters ************************************************************ */
+
+    K = records.size()/AS_NCOLS;
+    plhs[0] = mxCreateDoubleMatrix(K, AS_NCOLS, mxREAL);
+    R = mxGetPr(plhs[0]);
+    for (k = 0; k < K; k++)
+        for (col = 0; col < AS_NCOLS; col++)
+            R[k + col*K] = records[k*AS_NCOLS + col];
+
+    return;
+
+}
@@ -0,0 +1,347 @@
+/* Streaming audio excitement features, one record per second of a WAV file.                   */
+
+/* The same features as audio_features.m without holding the audio in memory: the file is read
+ * one second at a time and every buffer has a fixed size, whatever the length of the match.
+ *   band-pass   Butterworth of order AS_ORDER between AS_F1 and AS_F2 Hz (butter(7,[300 3200])
+ *               in audio_features.m), as a cascade of biquads whose state carries over from
+ *               one block to the next; both channels are filtered together in one SSE2 vector,
+ *   envelope    (|L|+|R|)/2 of the filtered signal,
+ *   threshold   max - mean of (|L|+|R|)/2 of the raw signal, over the last window seconds
+ *               (audio_features.m takes it over each pre-split chunk of the file).
+ * Envelope statistics and threshold counts are computed two frames at a time with SSE2 when
+ * available. Supported files: PCM 16, 24 or 32 bit and float 32 bit, mono or stereo (further
+ * channels are ignored).                                                                      */
+
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <complex>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AS_SSE2
+#include <emmintrin.h>
+#endif
+
+#define AS_ORDER         (7)
+#define AS_F1            (300.0)
+#define AS_F2            (3200.0)
+#define AS_MAX_SECTIONS  (16)
+#define AS_NCOLS         (8)
+
+#define AS_PI            (3.14159265358979323846)
+
+struct as_biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+struct as_stream {
+    FILE *f;
+    uint32_t fs, channels, bits, block_align;
+    int is_float;
+    uint64_t data_left;                /* bytes of samples not read yet */
+
+    as_biquad sec[AS_MAX_SECTIONS];
+    int nsec;
+    double z[AS_MAX_SECTIONS][4];      /* z1 L, z1 R, z2 L, z2 R of each section */
+
+    int window, filled, pos;           /* per-second raw max and sum over the last window s */
+    double *ring_max, *ring_sum;
+
+    unsigned char *raw;                /* one second of file bytes */
+    double *x;                         /* one second of stereo frames, interleaved L R */
+    long second;
+    int prev_active;
+};
+
+
+/* filter design */
+
+/* digital Butterworth band-pass of the given order between f1 and f2 Hz (bilinear transform
+ * with prewarping), as order biquads each with unit gain at the centre frequency */
+static inline int as_design_bandpass(int order, double f1, double f2, double fs, as_biquad *sec) {
+    typedef std::complex<double> cplx;
+    double w1, w2, w0, bw, wc;
+    cplx p, d, s[2], zp, zr, e1, e2, h;
+    int k, j, n = 0;
+
+    if (order < 1 || order > AS_MAX_SECTIONS || f1 <= 0 || f2 <= f1 || f2 >= fs/2) return 0;
+
+    w1 = 2*fs*tan(AS_PI*f1/fs);
+    w2 = 2*fs*tan(AS_PI*f2/fs);
+    w0 = sqrt(w1*w2);
+    bw = w2 - w1;
+    wc = 2*atan(w0/(2*fs));           /* digital centre frequency */
+
+    /* prototype poles in the upper half plane, each giving two band-pass poles that are paired
+     * with their conjugates in two biquads; the two band-pass poles of the real prototype pole
+     * of an odd order (a conjugate pair or two real poles) share the last biquad */
+    for (k = 0; k < (order + 1)/2; k++) {
+        p = std::polar(1.0, AS_PI*(2*k + order + 1)/(2.0*order));
+        d = std::sqrt(p*p*bw*bw - 4*w0*w0);
+        s[0] = (p*bw + d)/2.0;
+        s[1] = (p*bw - d)/2.0;
+        for (j = 0; j < 2; j++) {
+            zp = (2*fs + s[j])/(2*fs - s[j]);
+            sec[n].b0 = 1; sec[n].b1 = 0; sec[n].b2 = -1;
+            if (2*k + 1 == order) {
+                zr = (2*fs + s[1])/(2*fs - s[1]);
+                sec[n].a1 = -(zp + zr).real();
+                sec[n].a2 = (zp*zr).real();
+                j = 1;
+            } else {
+                sec[n].a1 = -2*zp.real();
+                sec[n].a2 = std::norm(zp);
+            }
+            /* unit gain at the centre frequency */
+            e1 = std::polar(1.0, -wc);
+            e2 = std::polar(1.0, -2*wc);
+            h = (sec[n].b0 + sec[n].b1*e1 + sec[n].b2*e2)/(1.0 + sec[n].a1*e1 + sec[n].a2*e2);
+            sec[n].b0 /= std::abs(h);
+            sec[n].b2 /= std::abs(h);
+            n++;
+        }
+    }
+    return n;
+} // as_design_bandpass
+
+
+/* block processing */
+
+/* run the cascade over n interleaved stereo frames, in place */
+static inline void as_filter(as_stream *s, double *x, long n) {
+    int k;
+    long i;
+
+    for (k = 0; k < s->nsec; k++) {
+        const as_biquad *q = &s->sec[k];
+        double *z = s->z[k];
+#ifdef AS_SSE2
+        __m128d b0 = _mm_set1_pd(q->b0), b1 = _mm_set1_pd(q->b1), b2 = _mm_set1_pd(q->b2);
+        __m128d a1 = _mm_set1_pd(q->a1), a2 = _mm_set1_pd(q->a2);
+        __m128d z1 = _mm_loadu_pd(z), z2 = _mm_loadu_pd(z + 2), in, y;
+        for (i = 0; i < n; i++) {
+            in = _mm_loadu_pd(x + 2*i);
+            y = _mm_add_pd(_mm_mul_pd(b0, in), z1);
+            z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, in), _mm_mul_pd(a1, y)), z2);
+            z2 = _mm_sub_pd(_mm_mul_pd(b2, in), _mm_mul_pd(a2, y));
+            _mm_storeu_pd(x + 2*i, y);
+        }
+        _mm_storeu_pd(z, z1);
+        _mm_storeu_pd(z + 2, z2);
+#else
+        double in, y;
+        int c;
+        for (i = 0; i < n; i++)
+            for (c = 0; c < 2; c++) {
+                in = x[2*i + c];
+                y = q->b0*in + z[c];
+                z[c] = q->b1*in - q->a1*y + z[2 + c];
+                z[2 + c] = q->b2*in - q->a2*y;
+                x[2*i + c] = y;
+            }
+#endif
+    }
+}
+
+/* sum, max, sum of squares and count above th of (|L|+|R|)/2 over n frames */
+static inline void as_envelope(const double *x, long n, double th, double *sum, double *max,
+        double *sq, long *above) {
+    double e;
+    long i = 0;
+
+    *sum = *max = *sq = 0;
+    *above = 0;
+#ifdef AS_SSE2
+    const __m128d sign = _mm_set1_pd(-0.0), half = _mm_set1_pd(0.5), t = _mm_set1_pd(th);
+    __m128d vsum = _mm_setzero_pd(), vmax = _mm_setzero_pd(), vsq = _mm_setzero_pd();
+    __m128d f0, f1, env;
+    double part[2];
+    int m;
+    for (; i + 2 <= n; i += 2) {
+        f0 = _mm_loadu_pd(x + 2*i);            /* L0 R0 */
+        f1 = _mm_loadu_pd(x + 2*i + 2);        /* L1 R1 */
+        vsq = _mm_add_pd(vsq, _mm_add_pd(_mm_mul_pd(f0, f0), _mm_mul_pd(f1, f1)));
+        f0 = _mm_andnot_pd(sign, f0);
+        f1 = _mm_andnot_pd(sign, f1);
+        env = _mm_mul_pd(half, _mm_add_pd(_mm_unpacklo_pd(f0, f1), _mm_unpackhi_pd(f0, f1)));
+        vsum = _mm_add_pd(vsum, env);
+        vmax = _mm_max_pd(vmax, env);
+        m = _mm_movemask_pd(_mm_cmpgt_pd(env, t));
+        *above += (m & 1) + (m >> 1);
+    }
+    _mm_storeu_pd(part, vsum); *sum = part[0] + part[1];
+    _mm_storeu_pd(part, vmax); *max = (part[0] > part[1] ? part[0] : part[1]);
+    _mm_storeu_pd(part, vsq);  *sq = part[0] + part[1];
+#endif
+    for (; i < n; i++) {
+        e = (fabs(x[2*i]) + fabs(x[2*i + 1]))/2;
+        *sum += e;
+        if (e > *max) *max = e;
+        *sq += x[2*i]*x[2*i] + x[2*i + 1]*x[2*i + 1];
+        if (e > th) (*above)++;
+    }
+}
+
+
+/* file access */
+
+static inline uint32_t as_u32(const unsigned char *p) {
+    return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline void as_close(as_stream *s) {
+    if (s->f) fclose(s->f);
+    free(s->ring_max);
+    free(s->ring_sum);
+    free(s->raw);
+    free(s->x);
+    memset(s, 0, sizeof(*s));
+}
+
+/* open a WAV file and set up the filter and the threshold window (seconds); 0 on success */
+static inline int as_open(const char *path, as_stream *s, int window) {
+    unsigned char h[40];
+    uint32_t len, format = 0;
+    int have_fmt = 0;
+
+    memset(s, 0, sizeof(*s));
+    s->f = fopen(path, "rb");
+    if (!s->f) return -1;
+    if (fread(h, 1, 12, s->f) != 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) {
+        as_close(s);
+        return -1;
+    }
+
+    /* walk the chunks up to the samples */
+    for (;;) {
+        if (fread(h, 1, 8, s->f) != 8) {
+            as_close(s);
+            return -1;
+        }
+        len = as_u32(h + 4);
+        if (memcmp(h, "fmt ", 4) == 0) {
+            if (len < 16 || fread(h, 1, len < 40 ? len : 40, s->f) != (len < 40 ? len : 40)) {
+                as_close(s);
+                return -1;
+            }
+            format = h[0] | h[1] << 8;
+            if (format == 0xfffe && len >= 26) format = h[24] | h[25] << 8;   /* extensible */
+            s->channels = h[2] | h[3] << 8;
+            s->fs = as_u32(h + 4);
+            s->block_align = h[12] | h[13] << 8;
+            s->bits = h[14] | h[15] << 8;
+            if (len > 40) fseek(s->f, len - 40, SEEK_CUR);
+            if (len & 1) fseek(s->f, 1, SEEK_CUR);
+            have_fmt = 1;
+        } else if (memcmp(h, "data", 4) == 0) {
+            /* streamed files (ffmpeg to a pipe) leave the length unset */
+            s->data_left = (len == 0 || len == 0xffffffffu ? UINT64_MAX : len);
+            break;
+        } else {
+            fseek(s->f, len + (len & 1), SEEK_CUR);
+        }
+    }
+
+    s->is_float = (format == 3);
+    if (!have_fmt || s->fs == 0 || s->channels == 0 || s->block_align != s->channels*(s->bits/8) ||
+            !((format == 1 && (s->bits == 16 || s->bits == 24 || s->bits == 32)) ||
+              (format == 3 && s->bits == 32))) {
+        as_close(s);
+        return -1;
+    }
+
+    s->nsec = as_design_bandpass(AS_ORDER, AS_F1, AS_F2, s->fs, s->sec);
+    if (s->nsec == 0) {
+        as_close(s);
+        return -1;
+    }
+
+    s->window = (window > 0 ? window : 1);
+    s->ring_max = (double *) calloc(s->window, sizeof(double));
+    s->ring_sum = (double *) calloc(s->window, sizeof(double));
+    s->raw = (unsigned char *) malloc((size_t) s->fs*s->block_align);
+    s->x = (double *) malloc((size_t) s->fs*2*sizeof(double));
+    if (!s->ring_max || !s->ring_sum || !s->raw || !s->x) {
+        as_close(s);
+        return -1;
+    }
+    return 0;
+} // as_open
+
+/* samples of one frame and channel as a double in [-1,1] */
+static inline double as_sample(const as_stream *s, const unsigned char *p) {
+    float f;
+    switch (s->bits) {
+        case 16: return (int16_t) (p[0] | p[1] << 8) / 32768.0;
+        case 24: return ((int32_t) ((uint32_t) p[0] << 8 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 24) >> 8) / 8388608.0;
+        default:
+            if (s->is_float) {
+                memcpy(&f, p, 4);
+                return f;
+            }
+            return (int32_t) as_u32(p) / 2147483648.0;
+    }
+}
+
+/* features of the next second into rec (AS_NCOLS values, see audio_stream.cpp, rec[0] being
+ * the 0-based index of the second in the file); returns 1, or 0 at the end of the file */
+static inline int as_next(as_stream *s, double rec[AS_NCOLS]) {
+    size_t want, got;
+    long n, i, above;
+    double raw_max, raw_sum, e, th, sum, max, sq;
+    int k, active;
+    unsigned int c1;
+
+    want = (size_t) s->fs*s->block_align;
+    if (s->data_left < want) want = (size_t) s->data_left;
+    got = (want ? fread(s->raw, 1, want, s->f) : 0);
+    n = (long) (got / s->block_align);
+    if (n == 0) return 0;
+    s->data_left -= (s->data_left == UINT64_MAX ? 0 : got);
+
+    /* stereo frames, mono duplicated */
+    c1 = (s->channels > 1 ? s->bits/8 : 0);
+    raw_max = raw_sum = 0;
+    for (i = 0; i < n; i++) {
+        s->x[2*i] = as_sample(s, s->raw + i*s->block_align);
+        s->x[2*i + 1] = as_sample(s, s->raw + i*s->block_align + c1);
+        e = (fabs(s->x[2*i]) + fabs(s->x[2*i + 1]))/2;
+        raw_sum += e;
+        if (e > raw_max) raw_max = e;
+    }
+
+    /* threshold from the raw signal over the last window seconds, this one included */
+    s->ring_max[s->pos] = raw_max;
+    s->ring_sum[s->pos] = raw_sum;
+    s->pos = (s->pos + 1) % s->window;
+    if (s->filled < s->window) s->filled++;
+    raw_max = raw_sum = 0;
+    for (k = 0; k < s->filled; k++) {
+        if (s->ring_max[k] > raw_max) raw_max = s->ring_max[k];
+        raw_sum += s->ring_sum[k];
+    }
+    th = raw_max - raw_sum/((double) s->fs*(s->filled - 1) + n);
+
+    as_filter(s, s->x, n);
+    as_envelope(s->x, n, th, &sum, &max, &sq, &above);
+
+    active = (above > 0);
+    rec[0] = (double) s->second;
+    rec[1] = active;
+    rec[2] = (double) above/n;
+    rec[3] = active - s->prev_active;
+    rec[4] = sqrt(sq/(2.0*n));
+    rec[5] = sum/n;
+    rec[6] = max;
+    rec[7] = th;
+
+    s->prev_active = active;
+    s->second++;
+    return 1;
+} // as_next
+
+#endif /* AUDIO_STREAM_H */
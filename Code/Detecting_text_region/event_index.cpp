@@ -0,0 +1,117 @@
+/* MATLAB access to the event window index of event_index.h.                                    */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex event_index.cpp
+ * then try it as follows:
+   n=event_index('load','..\..\Events');        % index all VidN.json, n = files read
+   E=event_index('overlap',1,2200,2400);        % windows of video 1 touching 2200..2400 s
+   [D,E]=event_index('nearest',1,[100 2280]);   % distance to, and closest window of, each time */
+
+/* E has one row [start end] (seconds) per window. D is 0 for times inside a window and -1 when
+ * the video has no events, in which case the row of E is [-1 -1]. The index stays loaded
+ * between calls until 'load' is called again or the MEX file is cleared.                      */
+
+#include "mex.h"
+#include "event_index.h"
+
+static evx_index events;
+static int loaded = 0;
+
+static void free_events(void) {
+    if (loaded) evx_free(&events);
+    loaded = 0;
+}
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    char cmd[16], *dir;
+    const evx_video *v;
+    int video, i, n, k, *hits;
+    double *t, *d, *e;
+    long dist;
+
+    /* Check for proper number of arguments */
+    if (nrhs < 1 || !mxIsChar(prhs[0]) || mxGetString(prhs[0], cmd, sizeof(cmd)) != 0)
+        mexErrMsgTxt("usage: n=event_index('load',dir); E=event_index('overlap',video,t0,t1); [D,E]=event_index('nearest',video,t);");
+    if (nlhs > 2)
+        mexErrMsgTxt("Too many output arguments.");
+
+    /* load ************************************************************************************ */
+    if (strcmp(cmd, "load") == 0) {
+        if (nrhs != 2 || !mxIsChar(prhs[1]))
+            mexErrMsgTxt("usage: n=event_index('load',dir); \n dir must be the Events folder");
+        free_events();
+        dir = mxArrayToString(prhs[1]);
+        n = evx_load(dir, &events);
+        mxFree(dir);
+        if (n == 0) {
+            evx_free(&events);
+            mexErrMsgTxt("event_index: no VidN.json found in dir");
+        }
+        loaded = 1;
+        mexAtExit(free_events);
+        plhs[0] = mxCreateDoubleScalar(n);
+        return;
+    }
+
+    if (!loaded)
+        mexErrMsgTxt("event_index: call event_index('load',dir) first");
+    if (nrhs < 3)
+        mexErrMsgTxt("usage: E=event_index('overlap',video,t0,t1); [D,E]=event_index('nearest',video,t);");
+    video = (int) mxGetScalar(prhs[1]);
+
+    /* overlap ********************************************************************************* */
+    if (strcmp(cmd, "overlap") == 0) {
+        long t0 = (long) mxGetScalar(prhs[2]);
+        long t1 = (nrhs > 3 ? (long) mxGetScalar(prhs[3]) : t0);
+
+        n = evx_overlap(&events, video, t0, t1, NULL, 0);
+        hits = (int *) mxCalloc(n ? n : 1, sizeof(int));
+        evx_overlap(&events, video, t0, t1, hits, n);
+        v = evx_get(&events, video);
+
+        plhs[0] = mxCreateDoubleMatrix(n, 2, mxREAL);
+        e = mxGetPr(plhs[0]);
+        for (i = 0; i < n; i++) {
+            e[i] = v->start[hits[i]];
+            e[i+n] = v->end[hits[i]];
+        }
+        mxFree(hits);
+        return;
+    }
+
+    /* nearest ********************************************************************************* */
+    if (strcmp(cmd, "nearest") == 0) {
+        if (!mxIsDouble(prhs[2]))
+            mexErrMsgTxt("usage: [D,E]=event_index('nearest',video,t); \n t must be double");
+        n = (int) mxGetNumberOfElements(prhs[2]);
+        t = mxGetPr(prhs[2]);
+        v = evx_get(&events, video);
+
+        plhs[0] = mxCreateDoubleMatrix(n, 1, mxREAL);
+        d = mxGetPr(plhs[0]);
+        e = NULL;
+        if (nlhs > 1) {
+            plhs[1] = mxCreateDoubleMatrix(n, 2, mxREAL);
+            e = mxGetPr(plhs[1]);
+        }
+        for (i = 0; i < n; i++) {
+            dist = evx_nearest(&events, video, (long) t[i], &k);
+            d[i] = dist;
+            if (e) {
+                e[i] = (dist < 0 ? -1 : v->start[k]);
+                e[i+n] = (dist < 0 ? -1 : v->end[k]);
+            }
+        }
+        return;
+    }
+
+    mexErrMsgTxt("event_index: unknown command, use 'load', 'overlap' or 'nearest'");
+
+}
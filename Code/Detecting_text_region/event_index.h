@@ -0,0 +1,257 @@
+/* Interval index over the annotated event windows of Events/VidN.json.                         */
+
+/* Each VidN.json lists the events of video N as
+   {"VideoNumber":"1","EventNumber":"1","Time":{"Start":"00:37:51","End":"00:38:14"}}
+ * evx_load reads all of them once and keeps, per video, the windows [start,end] in seconds
+ * sorted by start, together with an implicit balanced interval tree over that array: the node
+ * of the range lo..hi is its middle element and stores the largest end in the range. With it
+ *   evx_overlap  lists the windows intersecting [t0,t1]       in O(log n + k)
+ *   evx_nearest  gives the distance to the closest window      in O(log n)
+ * where the distance is 0 inside a window. Used by event_index.cpp and proesmans_batch.cpp.   */
+
+#ifndef EVENT_INDEX_H
+#define EVENT_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EVX_MAX_VIDEOS (1024)          /* video numbers tried when loading a folder */
+
+
+/* index structures */
+
+struct evx_video {
+    int count;
+    long *start, *end;                 /* windows sorted by start, in seconds */
+    long *max_end;                     /* interval tree: largest end below each node */
+    long *prefix_end;                  /* largest end among windows 0..i */
+    int *prefix_arg;                   /* last of windows 0..i ending at prefix_end[i] */
+};
+
+struct evx_index {
+    int num_videos;                    /* slots, slot v-1 holds video v */
+    evx_video *videos;
+};
+
+
+/* parsing */
+
+/* "HH:MM:SS" (or "MM:SS", or plain seconds) to seconds */
+static inline long evx_seconds(const char *p) {
+    long t = 0, part;
+    char *q;
+
+    for (;;) {
+        part = strtol(p, &q, 10);
+        if (q == p) break;
+        t = 60*t + part;
+        if (*q != ':') break;
+        p = q + 1;
+    }
+    return t;
+}
+
+/* value of "key" after p and before end, past the colon and opening quote */
+static inline const char *evx_value(const char *p, const char *end, const char *key) {
+    size_t n = strlen(key);
+    for (; p + n <= end; p++)
+        if (memcmp(p, key, n) == 0) {
+            p += n;
+            while (p < end && (*p == ':' || *p == '"' || *p == ' ')) p++;
+            return p;
+        }
+    return NULL;
+}
+
+
+/* tree construction and queries */
+
+static inline long evx_build(evx_video *v, int lo, int hi) {
+    int mid;
+    long m, r;
+
+    if (lo > hi) return -1;
+    mid = (lo + hi)/2;
+    m = v->end[mid];
+    r = evx_build(v, lo, mid-1);
+    if (r > m) m = r;
+    r = evx_build(v, mid+1, hi);
+    if (r > m) m = r;
+    v->max_end[mid] = m;
+    return m;
+}
+
+static inline void evx_sort(evx_video *v) {
+    int i, j;
+    long s, e;
+
+    /* insertion sort, the files are almost always in order already */
+    for (i = 1; i < v->count; i++) {
+        s = v->start[i];
+        e = v->end[i];
+        for (j = i - 1; j >= 0 && v->start[j] > s; j--) {
+            v->start[j+1] = v->start[j];
+            v->end[j+1] = v->end[j];
+        }
+        v->start[j+1] = s;
+        v->end[j+1] = e;
+    }
+}
+
+/* parse one VidN.json held in buf into v; returns the number of windows */
+static inline int evx_parse(const char *buf, long len, evx_video *v) {
+    const char *p, *end, *s, *e;
+    int cap, i;
+    long t0, t1;
+
+    end = buf + len;
+    cap = 64;
+    v->count = 0;
+    v->start = (long *) malloc(cap*sizeof(long));
+    v->end = (long *) malloc(cap*sizeof(long));
+
+    for (p = buf; (s = evx_value(p, end, "\"Start\"")) != NULL; p = e) {
+        e = evx_value(s, end, "\"End\"");
+        if (!e) break;
+        t0 = evx_seconds(s);
+        t1 = evx_seconds(e);
+        if (t1 < t0) { long t = t0; t0 = t1; t1 = t; }
+        if (v->count == cap) {
+            cap *= 2;
+            v->start = (long *) realloc(v->start, cap*sizeof(long));
+            v->end = (long *) realloc(v->end, cap*sizeof(long));
+        }
+        v->start[v->count] = t0;
+        v->end[v->count] = t1;
+        v->count++;
+    }
+
+    evx_sort(v);
+    v->max_end = (long *) malloc((v->count ? v->count : 1)*sizeof(long));
+    v->prefix_end = (long *) malloc((v->count ? v->count : 1)*sizeof(long));
+    v->prefix_arg = (int *) malloc((v->count ? v->count : 1)*sizeof(int));
+    evx_build(v, 0, v->count-1);
+    for (i = 0; i < v->count; i++) {
+        if (i > 0 && v->prefix_end[i-1] > v->end[i]) {
+            v->prefix_end[i] = v->prefix_end[i-1];
+            v->prefix_arg[i] = v->prefix_arg[i-1];
+        } else {
+            v->prefix_end[i] = v->end[i];
+            v->prefix_arg[i] = i;
+        }
+    }
+    return v->count;
+} // evx_parse
+
+static inline void evx_free(evx_index *x) {
+    int i;
+    for (i = 0; i < x->num_videos; i++) {
+        free(x->videos[i].start);
+        free(x->videos[i].end);
+        free(x->videos[i].max_end);
+        free(x->videos[i].prefix_end);
+        free(x->videos[i].prefix_arg);
+    }
+    free(x->videos);
+    x->videos = NULL;
+    x->num_videos = 0;
+}
+
+/* load every <dir>/VidN.json that exists; returns the number of files read */
+static inline int evx_load(const char *dir, evx_index *x) {
+    char name[2048];
+    char *buf;
+    FILE *f;
+    long len;
+    int n, loaded;
+
+    x->num_videos = 0;
+    x->videos = (evx_video *) calloc(EVX_MAX_VIDEOS, sizeof(evx_video));
+    loaded = 0;
+    for (n = 1; n <= EVX_MAX_VIDEOS; n++) {
+        snprintf(name, sizeof(name), "%s/Vid%d.json", dir, n);
+        f = fopen(name, "rb");
+        if (!f) continue;
+        fseek(f, 0, SEEK_END);
+        len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        buf = (char *) malloc(len + 1);
+        if (fread(buf, 1, len, f) == (size_t) len) {
+            evx_parse(buf, len, &x->videos[n-1]);
+            x->num_videos = n;
+            loaded++;
+        }
+        free(buf);
+        fclose(f);
+    }
+    return loaded;
+} // evx_load
+
+static inline const evx_video *evx_get(const evx_index *x, int video) {
+    if (video < 1 || video > x->num_videos || x->videos[video-1].count == 0) return NULL;
+    return &x->videos[video-1];
+}
+
+static inline int evx_overlap_node(const evx_video *v, int lo, int hi, long t0, long t1,
+        int *out, int max_out, int n) {
+    int mid;
+
+    if (lo > hi) return n;
+    mid = (lo + hi)/2;
+    if (v->max_end[mid] < t0) return n;           /* everything below ends before t0 */
+    n = evx_overlap_node(v, lo, mid-1, t0, t1, out, max_out, n);
+    if (v->start[mid] > t1) return n;             /* this and everything right start after t1 */
+    if (v->end[mid] >= t0) {
+        if (n < max_out) out[n] = mid;
+        n++;
+    }
+    return evx_overlap_node(v, mid+1, hi, t0, t1, out, max_out, n);
+}
+
+/* indices (into start/end, in start order) of the windows of video intersecting [t0,t1].
+ * Writes at most max_out of them and returns how many there are in total. */
+static inline int evx_overlap(const evx_index *x, int video, long t0, long t1,
+        int *out, int max_out) {
+    const evx_video *v = evx_get(x, video);
+    if (!v) return 0;
+    return evx_overlap_node(v, 0, v->count-1, t0, t1, out, max_out, 0);
+}
+
+/* distance in seconds from t to the closest window of video (0 inside one), -1 if the video has
+ * no events. which, if not NULL, receives the index of that window. */
+static inline long evx_nearest(const evx_index *x, int video, long t, int *which) {
+    const evx_video *v = evx_get(x, video);
+    int lo, hi, mid, best;
+    long d, best_d;
+
+    if (!v) return -1;
+
+    /* first window starting after t */
+    lo = 0;
+    hi = v->count;
+    while (lo < hi) {
+        mid = (lo + hi)/2;
+        if (v->start[mid] <= t) lo = mid + 1; else hi = mid;
+    }
+
+    best = -1;
+    best_d = -1;
+    if (lo < v->count) {
+        best = lo;
+        best_d = v->start[lo] - t;
+    }
+    /* of those starting at or before t, the one reaching furthest */
+    if (lo > 0) {
+        d = t - v->prefix_end[lo-1];
+        if (d < 0) d = 0;
+        if (best < 0 || d <= best_d) {
+            best = v->prefix_arg[lo-1];
+            best_d = d;
+        }
+    }
+    if (which) *which = best;
+    return best_d;
+} // evx_nearest
+
+#endif /* EVENT_INDEX_H */
@@ -0,0 +1,272 @@
+/* Moving blobs of a frame pair: connected components of the consistent optical flow.          */
+
+/* tracking.m thresholds frame differences with im2bw, labels them with bwlabel and then walks
+ * the pixels in MATLAB loops to find the moving regions. This MEX takes them from the Proesmans
+ * flow instead: the flow magnitude of every pixel is weighted by the forward/reverse consistency
+ * of compare() (0 where the flow leaves the image), thresholded, and the pixels above threshold
+ * are labelled (8-connected, as bwlabel) with a union-find run in parallel on bands of columns,
+ * the bands being joined afterwards along their borders. Blob statistics are then gathered in a
+ * single pass over the labels, in memory proportional to the number of blobs.                 */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex flow_blobs.cpp
+ * then try it as follows:
+   iter=50;lambda=30;level=4;thr=1;                     % same parameters as proesmans
+   [L,S]=flow_blobs(A,B,iter,lambda,level,thr);         % flow of frames A and B, then blobs
+   [L,S]=flow_blobs(F(:,:,:,k),R(:,:,:,k),thr,20);      % blobs of flows from proesmans_batch
+ * L is the label matrix (0 background, 1..K blobs numbered in column order, as bwlabel) and S
+ * has one row per blob:
+ *    1 area (pixels)               6-7  centroid (row, column)
+ *    2-5 [Ymin Ymax Xmin Xmax]     8-9  mean flow along the rows and along the columns
+ *                                  10   mean consistency weighted flow magnitude
+ * Optional arguments after thr: min_area (default 1, smaller blobs are dropped) and the number
+ * of threads (default: all cores).                                                            */
+
+/* basic MATLAB includes */
+#include "mex.h"
+#include <math.h>
+#include <thread>
+#include <vector>
+
+/* flow engine */
+#include "proesmans.h"
+
+#define NSTATS (10)
+
+
+/* union-find over pixel indices, the root of a set being its first pixel in column order */
+
+static inline int find_root(const int *parent, int p) {
+    while (parent[p] != p) p = parent[p];
+    return p;
+}
+
+static inline int find_halve(int *parent, int p) {
+    while (parent[p] != p) {
+        parent[p] = parent[parent[p]];
+        p = parent[p];
+    }
+    return p;
+}
+
+static inline void unite(int *parent, int a, int b) {
+    a = find_halve(parent, a);
+    b = find_halve(parent, b);
+    if (a < b) parent[b] = a;
+    else if (b < a) parent[a] = b;
+}
+
+/* label the foreground of columns c0..c1-1 of an m x n mask, joining only within the band */
+void label_band(const unsigned char *fg, int *parent, int m, int c0, int c1) {
+    int x, y, p;
+
+    for (y = c0; y < c1; y++)
+        for (x = 0; x < m; x++) {
+            p = x + y*m;
+            if (!fg[p]) {
+                parent[p] = -1;
+                continue;
+            }
+            parent[p] = p;
+            if (x > 0 && fg[p-1]) unite(parent, p, p-1);
+            if (y > c0) {
+                if (x > 0 && fg[p-m-1]) unite(parent, p, p-m-1);
+                if (fg[p-m]) unite(parent, p, p-m);
+                if (x < m-1 && fg[p-m+1]) unite(parent, p, p-m+1);
+            }
+        }
+}
+
+/* statistics of the blobs of L into st (NSTATS per label, label 1 first) */
+void blob_stats(const double *L, const float *W, const double *frw, int m, int n, double *st) {
+    int x, y, p;
+    double *s;
+
+    for (y = 0; y < n; y++)
+        for (x = 0; x < m; x++) {
+            p = x + y*m;
+            if (L[p] == 0) continue;
+            s = st + ((int) L[p] - 1)*NSTATS;
+            if (s[0] == 0) {
+                s[1] = s[2] = x + 1;
+                s[3] = s[4] = y + 1;
+            }
+            s[0] += 1;
+            s[1] = fmin(s[1], x + 1); s[2] = fmax(s[2], x + 1);
+            s[3] = fmin(s[3], y + 1); s[4] = fmax(s[4], y + 1);
+            s[5] += x + 1;
+            s[6] += y + 1;
+            s[7] += frw[p];
+            s[8] += frw[p + (size_t) m*n];
+            s[9] += W[p];
+        }
+}
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    const mwSize *size;
+    mwSize nd;
+    int m, n, k, x, y, p, t, nthreads, max_i, level, arg, K, min_area, j, c;
+    double lambda, thr, *L, *S, *frw, u, v;
+    std::vector<double> F, sums;
+    std::vector<float> W;
+    std::vector<unsigned char> fg;
+    std::vector<int> parent, root, bands, newlabel;
+    std::vector<std::thread> pool;
+    picture frame1, frame2;
+    twin_flows twoflows;
+    float **cf;
+
+    /* Check for proper number of arguments */
+    if (nrhs < 3 || nrhs > 8) {
+        mexErrMsgTxt("usage: [L,S]=flow_blobs(A,B,iter,lambda,level,thr,min_area,nthreads); or [L,S]=flow_blobs(F,R,thr,min_area,nthreads);");
+    } else if (nlhs > 2) {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+
+    /* deal with INPUT parameters ************************************************************* */
+
+    size = mxGetDimensions(prhs[0]);
+    nd = mxGetNumberOfDimensions(prhs[0]);
+    m = (int) size[0]; n = (int) size[1];
+    if ( mxGetM(prhs[0]) != mxGetM(prhs[1]) || mxGetN(prhs[0]) != mxGetN(prhs[1]) )
+        mexErrMsgTxt("flow_blobs: both frames (or both flows) must have the same dimensions");
+
+    if (mxGetClassID(prhs[0]) == mxUINT8_CLASS) {
+        /* two frames: compute their flows as proesmans does without estimate */
+        if (nrhs < 6 || mxGetClassID(prhs[1]) != mxUINT8_CLASS)
+            mexErrMsgTxt("usage: [L,S]=flow_blobs(A,B,iter,lambda,level,thr); \n A and B must be uint8");
+        k = (nd > 2 ? (int) size[2] : 1);
+        max_i = (int) mxGetScalar(prhs[2]);
+        lambda = mxGetScalar(prhs[3]);
+        level = (int) mxGetScalar(prhs[4]);
+        arg = 5;
+
+        frame1 = pictureOf((unsigned char *) mxGetData(prhs[0]), n, m, k);
+        frame2 = pictureOf((unsigned char *) mxGetData(prhs[1]), n, m, k);
+        twoflows.forward = alloc_flow(m, n);
+        twoflows.reverse = alloc_flow(m, n);
+        calculate_flow(frame1, frame2, max_i, lambda, level, twoflows, 0);
+        free_pic(frame1);
+        free_pic(frame2);
+        F.resize((size_t) 2*m*n);
+        flow2mat(&twoflows.forward, &F[0]);
+    } else {
+        /* forward and reverse flows, laid out as the outputs of proesmans */
+        if (!mxIsDouble(prhs[0]) || !mxIsDouble(prhs[1]) || nd != 3 || size[2] != 2 ||
+                mxGetNumberOfElements(prhs[1]) != mxGetNumberOfElements(prhs[0]))
+            mexErrMsgTxt("usage: [L,S]=flow_blobs(F,R,thr); \n F and R must be double HxWx2 flows");
+        arg = 2;
+        twoflows.forward = alloc_flow(m, n);
+        twoflows.reverse = alloc_flow(m, n);
+        mat2flow(mxGetPr(prhs[0]), &twoflows.forward);
+        mat2flow(mxGetPr(prhs[1]), &twoflows.reverse);
+        F.assign(mxGetPr(prhs[0]), mxGetPr(prhs[0]) + (size_t) 2*m*n);
+    }
+    frw = &F[0];
+
+    thr = mxGetScalar(prhs[arg]);
+    min_area = (nrhs > arg+1 ? (int) mxGetScalar(prhs[arg+1]) : 1);
+    nthreads = (nrhs > arg+2 ? (int) mxGetScalar(prhs[arg+2]) : (int) std::thread::hardware_concurrency());
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > n) nthreads = n;
+    if (nrhs > arg+3)
+        mexErrMsgTxt("flow_blobs: too many input arguments");
+
+    /* do the actual computations ************************************************************* */
+
+    /* consistency weighted flow magnitude and its threshold */
+    cf = compare(twoflows.forward, twoflows.reverse);
+    W.resize((size_t) m*n);
+    fg.resize((size_t) m*n);
+    for (y = 0; y < n; y++)
+        for (x = 0; x < m; x++) {
+            u = twoflows.forward.u[x][y];
+            v = twoflows.forward.v[x][y];
+            p = x + y*m;
+            W[p] = (cf[x][y] > 0 ? cf[x][y] : 0) * (float) sqrt(u*u + v*v);
+            fg[p] = (W[p] > thr);
+        }
+    free_float_space(cf);
+    free_flow(twoflows.forward);
+    free_flow(twoflows.reverse);
+
+    /* bands of columns, labelled in parallel */
+    bands.resize(nthreads + 1);
+    for (t = 0; t <= nthreads; t++) bands[t] = (int) ((long) n*t/nthreads);
+    parent.resize((size_t) m*n);
+    for (t = 0; t < nthreads; t++)
+        pool.push_back(std::thread(label_band, &fg[0], &parent[0], m, bands[t], bands[t+1]));
+    for (t = 0; t < nthreads; t++) pool[t].join();
+    pool.clear();
+
+    /* join the bands along their first column */
+    for (t = 1; t < nthreads; t++) {
+        y = bands[t];
+        for (x = 0; x < m; x++) {
+            p = x + y*m;
+            if (!fg[p]) continue;
+            if (x > 0 && fg[p-m-1]) unite(&parent[0], p, p-m-1);
+            if (fg[p-m]) unite(&parent[0], p, p-m);
+            if (x < m-1 && fg[p-m+1]) unite(&parent[0], p, p-m+1);
+        }
+    }
+
+    /* labels in column order of the first pixel of each blob */
+    root.resize((size_t) m*n);
+    newlabel.assign((size_t) m*n, 0);
+    for (t = 0; t < nthreads; t++)
+        pool.push_back(std::thread([&](int c0, int c1) {
+            for (int q = c0*m; q < c1*m; q++) root[q] = (parent[q] < 0 ? -1 : find_root(&parent[0], q));
+        }, bands[t], bands[t+1]));
+    for (t = 0; t < nthreads; t++) pool[t].join();
+    pool.clear();
+    K = 0;
+    for (p = 0; p < m*n; p++)
+        if (root[p] == p) newlabel[p] = ++K;
+
+    plhs[0] = mxCreateDoubleMatrix(m, n, mxREAL);
+    L = mxGetPr(plhs[0]);
+    for (t = 0; t < nthreads; t++)
+        pool.push_back(std::thread([&](int c0, int c1) {
+            for (int q = c0*m; q < c1*m; q++) L[q] = (root[q] < 0 ? 0 : newlabel[root[q]]);
+        }, bands[t], bands[t+1]));
+    for (t = 0; t < nthreads; t++) pool[t].join();
+    pool.clear();
+
+    /* blob statistics, one pass over the whole label matrix */
+    sums.assign((size_t) K*NSTATS, 0);
+    blob_stats(L, &W[0], frw, m, n, &sums[0]);
+
+    /* drop the small blobs, keeping the order of the others */
+    newlabel.assign(K + 1, 0);
+    c = 0;
+    for (j = 0; j < K; j++)
+        if (sums[(size_t) j*NSTATS] >= min_area) newlabel[j+1] = ++c;
+    if (c < K)
+        for (p = 0; p < m*n; p++) L[p] = newlabel[(int) L[p]];
+
+    /* deal with OUTPUT parameters ************************************************************ */
+
+    if (nlhs > 1) {
+        plhs[1] = mxCreateDoubleMatrix(c, NSTATS, mxREAL);
+        S = mxGetPr(plhs[1]);
+        for (j = 0; j < K; j++) {
+            const double *a = &sums[(size_t) j*NSTATS];
+            int r = newlabel[j+1] - 1;
+            if (r < 0) continue;
+            S[r] = a[0];
+            S[r + c*1] = a[1]; S[r + c*2] = a[2]; S[r + c*3] = a[3]; S[r + c*4] = a[4];
+            for (t = 5; t < NSTATS; t++) S[r + c*t] = a[t]/a[0];
+        }
+    }
+
+    return;
+
+}
@@ -0,0 +1,641 @@
+/* Persistent, content-addressed cache of Proesmans flow fields.                               */
+
+/* Every record holds the forward and reverse flow of one frame pair, keyed by a 128 bit hash of
+ * the two frames and of the solver parameters, so repeating an experiment on the same video
+ * finds its flows again whatever the script or the MATLAB session. Records are compressed:
+ *   quantization  u and v are stored as integers in steps of FC_STEP pixels (error <= step/2),
+ *                 clamped to +-FC_QMAX steps,
+ *   prediction    a record may reference the record of the previous pair of the same sequence
+ *                 and store only the difference (temporal delta); every FC_KEYFRAME records,
+ *                 or when there is no previous pair, each value is predicted from its neighbour
+ *                 along the column instead,
+ *   entropy       the zigzagged residual bytes are coded with a static order-0 rANS coder, one
+ *                 byte stream for 8 bit residuals or a low and a high stream for 16 bit ones.
+ * The cache is a single append-only file, memory-mapped for reading:
+ *   fc_file_header, then fc_record_header + payload for each record, 8 byte aligned,
+ * payload = one fc_stream_header (+ uint16 freq[256] when rANS coded) + bytes per stream.
+ * The in-memory index (key -> offset) is rebuilt by walking the record headers on fc_open.
+ * Several sessions may share the file: appends (and the cutting of a partial record left by an
+ * interrupted run) hold an exclusive lock on it, walks a shared one.                         */
+
+#ifndef FLOW_CACHE_H
+#define FLOW_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#endif
+
+#define FC_FILE_MAGIC   (0x31434c46u)  /* "FLC1" */
+#define FC_RECORD_MAGIC (0x31524346u)  /* "FCR1" */
+#define FC_STEP         (1.0/32.0)     /* quantization step in pixels */
+#define FC_QMAX         (16383)        /* +-512 pixels, keeps every residual within 16 bits */
+#define FC_KEYFRAME     (8)            /* longest chain of temporal deltas */
+
+#ifdef _WIN32
+#define FC_FTELL(f)     _ftelli64(f)
+#else
+#define FC_FTELL(f)     ftello(f)
+#endif
+
+#define FC_PROB_BITS    (12)
+#define FC_PROB_SCALE   (1u << FC_PROB_BITS)
+#define FC_RANS_L       (1u << 23)
+
+
+/* on-disk structures */
+
+struct fc_file_header {
+    uint32_t magic, version;
+    uint64_t reserved;
+};
+
+struct fc_key {
+    uint64_t a, b;
+};
+
+struct fc_record_header {
+    uint32_t magic;
+    uint32_t nstreams;                 /* 1: 8 bit residuals, 2: 16 bit residuals (low, high) */
+    fc_key key;
+    fc_key ref;                        /* previous pair this one is a delta of, or {0,0} */
+    uint32_t m, n;                     /* flow size, each record holds 4 planes of m*n values */
+    uint32_t depth;                    /* number of deltas back to a keyframe */
+    uint32_t pad;
+    uint64_t payload;                  /* payload bytes following this header */
+};
+
+struct fc_stream_header {
+    uint32_t raw_len;
+    uint32_t coded_len;
+    uint32_t method;                   /* 0 stored, 1 rANS with uint16 freq[256] following */
+    uint32_t pad;
+};
+
+
+/* the cache */
+
+struct fc_cache {
+    char path[1024];
+    const unsigned char *base;         /* read-only mapping of the first mapped bytes */
+    size_t mapped;
+    uint64_t size;                     /* bytes in the file, including appended records */
+    std::unordered_map<uint64_t, uint64_t> *index;
+#ifdef _WIN32
+    HANDLE file, map;
+#endif
+};
+
+
+/* hashing */
+
+static inline uint64_t fc_mix(uint64_t h) {
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t fc_hash(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = (const unsigned char *) data;
+    uint64_t h = seed ^ (len * 0x9e3779b97f4a7c15ULL), w;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&w, p + i, 8);
+        h ^= fc_mix(w + 0x9e3779b97f4a7c15ULL);
+        h = (h << 27 | h >> 37) * 0x100000001b3ULL;
+    }
+    w = 0;
+    memcpy(&w, p + i, len - i);
+    return fc_mix(h ^ fc_mix(w ^ 0x2545f4914f6cdd1dULL));
+}
+
+/* 128 bit content hash of one frame */
+static inline fc_key fc_frame_key(const unsigned char *frame, size_t bytes) {
+    fc_key k;
+    k.a = fc_hash(frame, bytes, 0x6a09e667f3bcc908ULL);
+    k.b = fc_hash(frame, bytes, 0xbb67ae8584caa73bULL);
+    return k;
+}
+
+/* key of a flow: both frames, their size and every solver parameter */
+static inline fc_key fc_pair_key(fc_key f1, fc_key f2, uint64_t m, uint64_t n, uint64_t k,
+        const double *params, int nparams) {
+    uint64_t buf[24];
+    fc_key key;
+    int i = 0, j;
+
+    buf[i++] = f1.a; buf[i++] = f1.b; buf[i++] = f2.a; buf[i++] = f2.b;
+    buf[i++] = m; buf[i++] = n; buf[i++] = k;
+    for (j = 0; j < nparams && i < 24; j++) memcpy(&buf[i++], &params[j], 8);
+    key.a = fc_hash(buf, i*8, 0x3c6ef372fe94f82bULL);
+    key.b = fc_hash(buf, i*8, 0xa54ff53a5f1d36f1ULL);
+    return key;
+}
+
+
+/* rANS entropy coder, static order-0 model */
+
+static inline void fc_freqs(const unsigned char *in, size_t n, uint16_t *freq) {
+    uint64_t count[256] = {0};
+    uint32_t sum, best;
+    size_t i;
+    int s;
+
+    for (i = 0; i < n; i++) count[in[i]]++;
+    sum = 0;
+    for (s = 0; s < 256; s++) {
+        freq[s] = 0;
+        if (count[s]) {
+            freq[s] = (uint16_t) (count[s]*FC_PROB_SCALE/n);
+            if (freq[s] == 0) freq[s] = 1;
+        }
+        sum += freq[s];
+    }
+    /* adjust the total to exactly FC_PROB_SCALE on the most frequent symbols */
+    while (sum != FC_PROB_SCALE) {
+        best = 0;
+        for (s = 1; s < 256; s++) if (freq[s] > freq[best]) best = s;
+        if (sum < FC_PROB_SCALE) {
+            freq[best] += (uint16_t) (FC_PROB_SCALE - sum);
+            sum = FC_PROB_SCALE;
+        } else {
+            uint32_t cut = sum - FC_PROB_SCALE;
+            if (cut > (uint32_t) freq[best] - 1) cut = freq[best] - 1;
+            freq[best] -= (uint16_t) cut;
+            sum -= cut;
+        }
+    }
+}
+
+/* codes in[0..n) into out (capacity 2n+8), returns the coded length */
+static inline size_t fc_rans_encode(const unsigned char *in, size_t n, const uint16_t *freq,
+        unsigned char *out) {
+    uint32_t cum[257], x, f, x_max;
+    unsigned char *end = out + 2*n + 8, *ptr = end;
+    size_t i, len;
+    int s;
+
+    cum[0] = 0;
+    for (s = 0; s < 256; s++) cum[s+1] = cum[s] + freq[s];
+
+    x = FC_RANS_L;
+    for (i = n; i > 0; i--) {
+        s = in[i-1];
+        f = freq[s];
+        x_max = ((FC_RANS_L >> FC_PROB_BITS) << 8) * f;
+        while (x >= x_max) {
+            *--ptr = (unsigned char) (x & 0xff);
+            x >>= 8;
+        }
+        x = ((x / f) << FC_PROB_BITS) + (x % f) + cum[s];
+    }
+    ptr -= 4;
+    ptr[0] = (unsigned char) (x);
+    ptr[1] = (unsigned char) (x >> 8);
+    ptr[2] = (unsigned char) (x >> 16);
+    ptr[3] = (unsigned char) (x >> 24);
+
+    len = end - ptr;
+    memmove(out, ptr, len);
+    return len;
+}
+
+/* decodes n symbols from in[0..len), returns 0 on success */
+static inline int fc_rans_decode(const unsigned char *in, size_t len, const uint16_t *freq,
+        unsigned char *out, size_t n) {
+    uint32_t cum[257], x, slot;
+    unsigned char sym[FC_PROB_SCALE];
+    const unsigned char *end = in + len;
+    size_t i;
+    int s;
+
+    cum[0] = 0;
+    for (s = 0; s < 256; s++) {
+        cum[s+1] = cum[s] + freq[s];
+        if (cum[s+1] > FC_PROB_SCALE) return -1;
+        memset(sym + cum[s], s, freq[s]);
+    }
+    if (cum[256] != FC_PROB_SCALE || len < 4) return -1;
+
+    x = in[0] | (uint32_t) in[1] << 8 | (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+    in += 4;
+    for (i = 0; i < n; i++) {
+        slot = x & (FC_PROB_SCALE - 1);
+        s = sym[slot];
+        out[i] = (unsigned char) s;
+        x = freq[s] * (x >> FC_PROB_BITS) + slot - cum[s];
+        while (x < FC_RANS_L) {
+            if (in >= end) return -1;
+            x = (x << 8) | *in++;
+        }
+    }
+    return 0;
+}
+
+
+/* quantization */
+
+static inline int16_t fc_quantize(double v) {
+    double q = floor(v / FC_STEP + 0.5);
+    if (q > FC_QMAX) q = FC_QMAX;
+    if (q < -FC_QMAX) q = -FC_QMAX;
+    return (int16_t) q;
+}
+
+/* forward and reverse flow (as laid out by flow2mat) to the 4 planes of a record */
+static inline void fc_quantize_flows(const double *frw, const double *rev, size_t mn, int16_t *q) {
+    size_t i;
+    for (i = 0; i < 2*mn; i++) {
+        q[i] = fc_quantize(frw[i]);
+        q[2*mn + i] = fc_quantize(rev[i]);
+    }
+}
+
+static inline void fc_dequantize_flows(const int16_t *q, size_t mn, double *frw, double *rev) {
+    size_t i;
+    for (i = 0; i < 2*mn; i++) {
+        frw[i] = q[i] * FC_STEP;
+        rev[i] = q[2*mn + i] * FC_STEP;
+    }
+}
+
+
+/* file access */
+
+static inline void fc_unmap(fc_cache *c) {
+#ifdef _WIN32
+    if (c->base) UnmapViewOfFile(c->base);
+    if (c->map) CloseHandle(c->map);
+    if (c->file && c->file != INVALID_HANDLE_VALUE) CloseHandle(c->file);
+    c->file = NULL;
+    c->map = NULL;
+#else
+    if (c->base) munmap((void *) c->base, c->mapped);
+#endif
+    c->base = NULL;
+    c->mapped = 0;
+}
+
+/* map the whole file as it is now; returns 0 on success */
+static inline int fc_map(fc_cache *c) {
+    fc_unmap(c);
+#ifdef _WIN32
+    LARGE_INTEGER len;
+    c->file = CreateFileA(c->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (c->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(c->file, &len)) return -1;
+    c->mapped = (size_t) len.QuadPart;
+    c->map = CreateFileMappingA(c->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (c->map) c->base = (const unsigned char *) MapViewOfFile(c->map, FILE_MAP_READ, 0, 0, 0);
+#else
+    struct stat st;
+    int fd = open(c->path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    c->mapped = (size_t) st.st_size;
+    c->base = (const unsigned char *) mmap(NULL, c->mapped, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (c->base == MAP_FAILED) c->base = NULL;
+#endif
+    if (!c->base) {
+        c->mapped = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* lock the whole cache file against the other sessions, shared (walks) or exclusive (appends);
+ * the lock file handle is returned in l. 0 on success */
+#ifdef _WIN32
+typedef HANDLE fc_lock_t;
+#else
+typedef int fc_lock_t;
+#endif
+
+static inline int fc_lock(const char *path, int exclusive, fc_lock_t *l) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    *l = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (*l == INVALID_HANDLE_VALUE) return -1;
+    /* a byte far past the end, so that the lock does not block our own reads and writes */
+    memset(&ov, 0, sizeof(ov));
+    ov.OffsetHigh = 0x7fffffff;
+    if (!LockFileEx(*l, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &ov)) {
+        CloseHandle(*l);
+        return -1;
+    }
+#else
+    *l = open(path, O_RDWR | O_CREAT, 0644);
+    if (*l < 0) return -1;
+    if (flock(*l, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+        close(*l);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static inline void fc_unlock(fc_lock_t l) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.OffsetHigh = 0x7fffffff;
+    UnlockFileEx(l, 0, 1, 0, &ov);
+    CloseHandle(l);
+#else
+    flock(l, LOCK_UN);
+    close(l);
+#endif
+}
+
+/* cut the file to len bytes; 0 on success */
+static inline int fc_truncate(const char *path, uint64_t len) {
+#ifdef _WIN32
+    LARGE_INTEGER pos;
+    HANDLE h = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    int ok;
+    if (h == INVALID_HANDLE_VALUE) return -1;
+    pos.QuadPart = (LONGLONG) len;
+    ok = SetFilePointerEx(h, pos, NULL, FILE_BEGIN) && SetEndOfFile(h);
+    CloseHandle(h);
+    return (ok ? 0 : -1);
+#else
+    return truncate(path, (off_t) len);
+#endif
+}
+
+static inline void fc_close(fc_cache *c) {
+    fc_unmap(c);
+    delete c->index;
+    c->index = NULL;
+    c->path[0] = 0;
+}
+
+/* index the records from c->size to the end of the file, as it is now (other sessions may have
+ * appended to it), and leave c->size after the last complete one. The caller holds a lock, so
+ * an incomplete record past it can only be left by an interrupted run. 0 on success */
+static inline int fc_sync(fc_cache *c) {
+    const fc_record_header *r;
+    uint64_t off;
+
+    if (fc_map(c) != 0) return -1;
+    off = c->size;
+    while (off + sizeof(fc_record_header) <= c->mapped) {
+        r = (const fc_record_header *) (c->base + off);
+        if (r->magic != FC_RECORD_MAGIC || off + sizeof(*r) + r->payload > c->mapped) break;
+        (*c->index)[r->key.a] = off;
+        off += (sizeof(*r) + r->payload + 7) & ~(uint64_t) 7;
+    }
+    c->size = off;
+    return 0;
+} // fc_sync
+
+/* open (creating it if needed) the cache file and index its records; returns 0 on success */
+static inline int fc_open(const char *path, fc_cache *c) {
+    fc_file_header fh;
+    fc_lock_t l;
+    FILE *f;
+    int ok;
+
+    memset(c, 0, sizeof(*c));
+    strncpy(c->path, path, sizeof(c->path)-1);
+
+    /* a new (empty) file gets its header, only once whatever the sessions racing to create it */
+    if (fc_lock(path, 1, &l) != 0) return -1;
+    f = fopen(path, "ab");
+    ok = (f != NULL);
+    if (f && fseek(f, 0, SEEK_END) == 0 && FC_FTELL(f) == 0) {
+        memset(&fh, 0, sizeof(fh));
+        fh.magic = FC_FILE_MAGIC;
+        fh.version = 1;
+        ok = (fwrite(&fh, sizeof(fh), 1, f) == 1);
+    }
+    if (f) ok = (fclose(f) == 0) && ok;
+    fc_unlock(l);
+    if (!ok) return -1;
+
+    if (fc_lock(path, 0, &l) != 0) return -1;
+    c->index = new std::unordered_map<uint64_t, uint64_t>();
+    c->size = sizeof(fc_file_header);
+    ok = (fc_map(c) == 0 && c->mapped >= sizeof(fc_file_header) &&
+            ((const fc_file_header *) c->base)->magic == FC_FILE_MAGIC && fc_sync(c) == 0);
+    fc_unlock(l);
+    if (!ok) {
+        fc_close(c);
+        return -1;
+    }
+    return 0;
+} // fc_open
+
+static inline const fc_record_header *fc_find(fc_cache *c, fc_key key) {
+    const fc_record_header *r;
+    std::unordered_map<uint64_t, uint64_t>::const_iterator it = c->index->find(key.a);
+
+    if (it == c->index->end()) return NULL;
+    if (it->second + sizeof(fc_record_header) > c->mapped && fc_map(c) != 0) return NULL;
+    r = (const fc_record_header *) (c->base + it->second);
+    if (it->second + sizeof(*r) + r->payload > c->mapped) return NULL;
+    return (r->key.b == key.b ? r : NULL);
+}
+
+
+/* decoding */
+
+/* quantized planes (4*m*n values) of the record of key into q; hint_q, if not NULL, holds the
+ * already decoded planes of hint_key, to avoid walking back the delta chain. 0 on success. */
+static inline int fc_get(fc_cache *c, fc_key key, uint32_t m, uint32_t n, int16_t *q,
+        const fc_key *hint_key, const int16_t *hint_q) {
+    const fc_record_header *r = fc_find(c, key);
+    const fc_stream_header *sh;
+    const unsigned char *p, *end;
+    std::vector<unsigned char> bytes[2];
+    std::vector<int16_t> ref;
+    const int16_t *pred;
+    size_t count, i, plane, s;
+    uint32_t z;
+    int32_t v;
+
+    if (!r || r->m != m || r->n != n || r->nstreams < 1 || r->nstreams > 2) return -1;
+    count = (size_t) 4*m*n;
+    plane = (size_t) m*n;
+
+    /* the record this one is a delta of */
+    pred = NULL;
+    if (r->ref.a || r->ref.b) {
+        if (hint_key && hint_q && hint_key->a == r->ref.a && hint_key->b == r->ref.b) {
+            pred = hint_q;
+        } else {
+            ref.resize(count);
+            if (fc_get(c, r->ref, m, n, &ref[0], NULL, NULL) != 0) return -1;
+            pred = &ref[0];
+            r = fc_find(c, key);       /* the file may have been remapped */
+            if (!r) return -1;
+        }
+    }
+
+    /* entropy decode the byte streams */
+    p = (const unsigned char *) (r + 1);
+    end = p + r->payload;
+    for (s = 0; s < r->nstreams; s++) {
+        if (p + sizeof(fc_stream_header) > end) return -1;
+        sh = (const fc_stream_header *) p;
+        p += sizeof(*sh);
+        if (sh->raw_len != count) return -1;
+        bytes[s].resize(count);
+        if (sh->method == 0) {
+            if (p + sh->raw_len > end) return -1;
+            memcpy(&bytes[s][0], p, count);
+            p += sh->raw_len;
+        } else {
+            if (p + 512 + sh->coded_len > end) return -1;
+            if (fc_rans_decode(p + 512, sh->coded_len, (const uint16_t *) p, &bytes[s][0], count) != 0)
+                return -1;
+            p += 512 + sh->coded_len;
+        }
+        p += (8 - (sh->coded_len % 8)) % 8;
+    }
+
+    /* undo zigzag and prediction */
+    for (i = 0; i < count; i++) {
+        z = bytes[0][i];
+        if (r->nstreams == 2) z |= (uint32_t) bytes[1][i] << 8;
+        v = (int32_t) (z >> 1) ^ -(int32_t) (z & 1);
+        if (pred) v += pred[i];
+        else if (i % plane) v += q[i-1];
+        q[i] = (int16_t) v;
+    }
+    return 0;
+} // fc_get
+
+
+/* encoding */
+
+/* append the planes q (4*m*n values) under key, as a delta of ref_q (the planes of ref_key) when
+ * given. depth is that of the new record (0 for a keyframe). 0 on success. */
+static inline int fc_put(fc_cache *c, fc_key key, uint32_t m, uint32_t n, const int16_t *q,
+        const fc_key *ref_key, const int16_t *ref_q, uint32_t depth) {
+    fc_record_header r;
+    fc_stream_header sh;
+    std::vector<unsigned char> bytes[2], coded;
+    uint16_t freq[256];
+    size_t count, plane, i, s;
+    uint32_t z, zmax;
+    int32_t v;
+    uint64_t off = 0, len;
+    static const unsigned char zeros[8] = {0};
+    fc_lock_t l;
+    FILE *f;
+    int ok;
+
+    if (fc_find(c, key)) return 0;     /* already there */
+    count = (size_t) 4*m*n;
+    plane = (size_t) m*n;
+
+    memset(&r, 0, sizeof(r));
+    r.magic = FC_RECORD_MAGIC;
+    r.key = key;
+    if (ref_key && ref_q) r.ref = *ref_key;
+    else depth = 0;
+    r.m = m;
+    r.n = n;
+    r.depth = depth;
+
+    /* prediction residuals, zigzagged */
+    bytes[0].resize(count);
+    bytes[1].resize(count);
+    zmax = 0;
+    for (i = 0; i < count; i++) {
+        if (ref_key && ref_q) v = (int32_t) q[i] - ref_q[i];
+        else v = (int32_t) q[i] - (i % plane ? q[i-1] : 0);
+        z = ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+        if (z > zmax) zmax = z;
+        bytes[0][i] = (unsigned char) z;
+        bytes[1][i] = (unsigned char) (z >> 8);
+    }
+    r.nstreams = (zmax < 256 ? 1 : 2);
+
+    /* entropy code each stream, keeping it raw if that is not smaller */
+    std::vector<unsigned char> payload;
+    for (s = 0; s < r.nstreams; s++) {
+        memset(&sh, 0, sizeof(sh));
+        sh.raw_len = (uint32_t) count;
+        fc_freqs(&bytes[s][0], count, freq);
+        coded.resize(2*count + 8);
+        len = fc_rans_encode(&bytes[s][0], count, freq, &coded[0]);
+        if (len + 512 < count) {
+            sh.method = 1;
+            sh.coded_len = (uint32_t) len;
+        } else {
+            sh.method = 0;
+            sh.coded_len = (uint32_t) count;
+        }
+        payload.insert(payload.end(), (unsigned char *) &sh, (unsigned char *) (&sh + 1));
+        if (sh.method == 1) {
+            payload.insert(payload.end(), (unsigned char *) freq, (unsigned char *) (freq + 256));
+            payload.insert(payload.end(), coded.begin(), coded.begin() + len);
+        } else {
+            payload.insert(payload.end(), bytes[s].begin(), bytes[s].end());
+        }
+        payload.insert(payload.end(), zeros, zeros + (8 - (sh.coded_len % 8)) % 8);
+    }
+    r.payload = payload.size();
+
+    /* append, under the exclusive lock from the check of the end of the file to the last byte:
+     * if other sessions moved the end, catch up with their records first; what is left past the
+     * last complete record is then from an interrupted run and is cut off */
+    if (fc_lock(c->path, 1, &l) != 0) return -1;
+    f = fopen(c->path, "ab");
+    ok = (f != NULL && fseek(f, 0, SEEK_END) == 0 && FC_FTELL(f) >= 0);
+    if (ok && (uint64_t) FC_FTELL(f) != c->size) {
+        fclose(f);
+        f = NULL;
+        ok = (fc_sync(c) == 0);
+        if (ok && fc_find(c, key)) {
+            fc_unlock(l);
+            return 0;
+        }
+        if (ok && c->size < c->mapped) {
+            fc_unmap(c);
+            ok = (fc_truncate(c->path, c->size) == 0);
+        }
+        if (ok) {
+            f = fopen(c->path, "ab");
+            ok = (f != NULL && fseek(f, 0, SEEK_END) == 0 && (uint64_t) FC_FTELL(f) == c->size);
+        }
+    }
+    if (ok) {
+        off = (uint64_t) FC_FTELL(f);
+        ok = fwrite(&r, sizeof(r), 1, f) == 1;
+        ok = ok && fwrite(&payload[0], 1, payload.size(), f) == payload.size();
+        ok = ok && fwrite(zeros, 1, (8 - (payload.size() % 8)) % 8, f) == (8 - (payload.size() % 8)) % 8;
+    }
+    if (f) ok = (fclose(f) == 0) && ok;
+    fc_unlock(l);
+    if (!ok) return -1;
+
+    (*c->index)[key.a] = off;
+    c->size = off + ((sizeof(r) + r.payload + 7) & ~(uint64_t) 7);
+    return 0;
+} // fc_put
+
+#endif /* FLOW_CACHE_H */
@@ -0,0 +1,293 @@
+/* Event-driven batch optical flow over a sequence of sampled frames, using the Proesmans engine. */
+
+/* Calling proesmans once per sampled second spends the same effort on every second of a match,
+ * although the annotated events (Events/VidN.json) cover only a small part of it. This MEX takes
+ * a whole batch of frames with their times and schedules the work around the event windows:
+ *   dense   pairs within margin seconds of an event get the full iter/level computation,
+ *   coarse  elsewhere one pair every stride seconds is solved on the half-size pyramid level
+ *           only (iter/2 iterations, level-1) and scaled back up,
+ *   skipped the remaining pairs are left at zero flow.
+ * Each frame is converted only once even though it belongs to two consecutive pairs.
+ * With a cache file (flow_cache.h) every computed pair is stored under the hash of its frames
+ * and parameters, and pairs found there are read back instead of being solved again, so a
+ * repeated experiment costs only the reading. Flows read from the cache are quantized to
+ * 1/32 pixel.                                                                                */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex proesmans_batch.cpp
+ * then try it as follows:
+   I=cat(4,A,B,C);T=[2223 2224 2225];                  % frames (uint8 HxWx3xN) and their seconds
+   iter=50;lambda=30;level=4;                          % same parameters as proesmans
+   [F,R,M]=proesmans_batch(I,T,iter,lambda,level,1,'..\..\Events',5,5);
+   [F,R,M,C]=proesmans_batch(I,T,iter,lambda,level,1,'..\..\Events',5,5,'flows.fcache');
+ * F(:,:,:,k) and R(:,:,:,k) are the forward and reverse flows between frames k and k+1, laid
+ * out as the outputs of proesmans, and M(k) is 2, 1 or 0 for a dense, coarse or skipped pair.
+ * Without the events arguments (or with an empty events folder) every pair is dense, and C(k)
+ * is 1 for the pairs read from the cache.                                                     */
+
+/* basic MATLAB includes */
+#include "mex.h"
+#include <string.h>
+#include <vector>
+
+/* flow engine, event windows and flow cache */
+#include "proesmans.h"
+#include "event_index.h"
+#include "flow_cache.h"
+
+#define MODE_SKIPPED (0)
+#define MODE_COARSE  (1)
+#define MODE_DENSE   (2)
+
+static evx_index events;
+static char events_dir[1024] = "";
+
+static fc_cache cache;
+
+static void free_events(void) {
+    if (events_dir[0]) evx_free(&events);
+    events_dir[0] = 0;
+}
+
+static void close_cache(void) {
+    if (cache.index) fc_close(&cache);
+}
+
+
+/* flow of one pair at the full resolution (dense) or at half the resolution (coarse) */
+
+twin_flows pair_flow(picture P1, picture P2, int max_i, float lambda, int level, int mode) {
+    twin_flows flows, halff;
+    picture half1, half2;
+
+    flows.forward = alloc_flow(P1.width, P1.height);
+    flows.reverse = alloc_flow(P1.width, P1.height);
+
+    if (mode == MODE_DENSE) {
+        calculate_flow(P1, P2, max_i, lambda, level, flows, 0);
+    } else {
+        /* this is the first stage of the dense computation, without the finest level */
+        half1 = half_pic(P1);
+        half2 = half_pic(P2);
+        halff.forward = alloc_flow(half1.width, half1.height);
+        halff.reverse = alloc_flow(half1.width, half1.height);
+        calculate_flow(half1, half2, MAX(max_i/2, 1), lambda, MAX(level-1, 0), halff, 0);
+        double_flow(halff.forward, flows.forward);
+        double_flow(halff.reverse, flows.reverse);
+        fix_edges(&flows.forward);
+        fix_edges(&flows.reverse);
+        free_flow(halff.forward);
+        free_flow(halff.reverse);
+        free_pic(half1);
+        free_pic(half2);
+    }
+
+    return flows;
+}
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    unsigned char *I;
+    double *T, *frw, *rev, *modes, *cached, lambda, margin, stride, last_coarse, params[4];
+    unsigned int max_i, level;
+    int video, use_events, use_cache, have[2], mode, prev_valid;
+    uint32_t prev_depth;
+    mwSize m, n, k, N, p, odims[4];
+    const mwSize *size;
+    char *dir;
+    picture pics[2];
+    twin_flows flows;
+    std::vector<fc_key> frame_keys;
+    std::vector<char> have_key;
+    std::vector<int16_t> q, prev_q;
+    fc_key key, prev_key;
+
+    /* Check for proper number of arguments */
+    if (nrhs != 5 && nrhs != 9 && nrhs != 10) {
+        mexErrMsgTxt("usage: [F,R,M,C]=proesmans_batch(I,T,iter,lambda,level,video,events_dir,margin,stride,cache_file);");
+    } else if (nlhs > 4) {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+
+    /* deal with INPUT parameters ************************************************************* */
+
+    if ( mxIsSparse(prhs[0]) || mxGetClassID(prhs[0])!= mxUINT8_CLASS || mxGetNumberOfDimensions(prhs[0]) != 4)
+        mexErrMsgTxt("usage: [F,R,M]=proesmans_batch(I,T,...); \n I must be a uint8 HxWxCxN array of frames");
+    if ( !mxIsDouble(prhs[1]) )
+        mexErrMsgTxt("usage: [F,R,M]=proesmans_batch(I,T,...); \n T must be double");
+
+    size = mxGetDimensions(prhs[0]);
+    m = size[0]; n = size[1]; k = size[2]; N = size[3];
+    if ( mxGetNumberOfElements(prhs[1]) != N )
+        mexErrMsgTxt("usage: [F,R,M]=proesmans_batch(I,T,...); \n T must have one time per frame");
+    if ( N < 2 )
+        mexErrMsgTxt("proesmans_batch: at least two frames are needed");
+
+    I = (unsigned char *) mxGetData(prhs[0]);
+    T = mxGetPr(prhs[1]);
+    max_i = (unsigned int) mxGetScalar(prhs[2]);
+    lambda = mxGetScalar(prhs[3]);
+    level = (unsigned int) mxGetScalar(prhs[4]);
+
+    use_events = 0;
+    video = 0;
+    margin = stride = 0;
+    if (nrhs >= 9) {
+        video = (int) mxGetScalar(prhs[5]);
+        margin = mxGetScalar(prhs[7]);
+        stride = mxGetScalar(prhs[8]);
+        if (mxIsChar(prhs[6]) && mxGetNumberOfElements(prhs[6]) > 0) {
+            /* the index is kept between calls for the same folder */
+            dir = mxArrayToString(prhs[6]);
+            if (strcmp(dir, events_dir) != 0) {
+                free_events();
+                if (evx_load(dir, &events) == 0) {
+                    evx_free(&events);
+                    mxFree(dir);
+                    mexErrMsgTxt("proesmans_batch: no VidN.json found in events_dir");
+                }
+                strncpy(events_dir, dir, sizeof(events_dir)-1);
+                mexAtExit(free_events);
+            }
+            mxFree(dir);
+            use_events = 1;
+        }
+    }
+
+    use_cache = 0;
+    if (nrhs == 10 && mxIsChar(prhs[9]) && mxGetNumberOfElements(prhs[9]) > 0) {
+        /* the cache stays open between calls for the same file */
+        dir = mxArrayToString(prhs[9]);
+        if (!cache.index || strcmp(dir, cache.path) != 0) {
+            close_cache();
+            if (fc_open(dir, &cache) != 0) {
+                mxFree(dir);
+                mexErrMsgTxt("proesmans_batch: cannot open or create the cache file");
+            }
+            mexAtExit(close_cache);
+        }
+        mxFree(dir);
+        use_cache = 1;
+        frame_keys.resize(N);
+        have_key.assign(N, 0);
+        q.resize(4*m*n);
+        prev_q.resize(4*m*n);
+    }
+
+    /* deal with OUTPUT parameters ************************************************************ */
+
+    odims[0] = m; odims[1] = n; odims[2] = 2; odims[3] = N-1;
+    plhs[0] = mxCreateNumericArray(4, odims, mxDOUBLE_CLASS, mxREAL);
+    plhs[1] = mxCreateNumericArray(4, odims, mxDOUBLE_CLASS, mxREAL);
+    frw = mxGetPr(plhs[0]);
+    rev = mxGetPr(plhs[1]);
+    modes = NULL;
+    if (nlhs > 2) {
+        plhs[2] = mxCreateDoubleMatrix(1, N-1, mxREAL);
+        modes = mxGetPr(plhs[2]);
+    }
+    cached = NULL;
+    if (nlhs > 3) {
+        plhs[3] = mxCreateDoubleMatrix(1, N-1, mxREAL);
+        cached = mxGetPr(plhs[3]);
+    }
+
+    /* do the actual computations ************************************************************* */
+
+    have[0] = have[1] = -1;
+    last_coarse = -1e300;
+    prev_valid = 0;
+    prev_depth = 0;
+    for (p = 0; p + 1 < N; p++) {
+
+        /* schedule the pair */
+        if (!use_events ||
+                evx_overlap(&events, video, (long) floor(T[p] - margin), (long) ceil(T[p+1] + margin), NULL, 0) > 0) {
+            mode = MODE_DENSE;
+        } else if (T[p] - last_coarse >= stride) {
+            mode = MODE_COARSE;
+            last_coarse = T[p];
+        } else {
+            mode = MODE_SKIPPED;
+        }
+        if (modes) modes[p] = mode;
+        if (mode == MODE_SKIPPED) {
+            prev_valid = 0;
+            continue;
+        }
+
+        /* look the pair up in the cache, the previous pair being the likely delta reference */
+        if (use_cache) {
+            if (!have_key[p]) frame_keys[p] = fc_frame_key(I + p*m*n*k, m*n*k);
+            if (!have_key[p+1]) frame_keys[p+1] = fc_frame_key(I + (p+1)*m*n*k, m*n*k);
+            have_key[p] = have_key[p+1] = 1;
+            params[0] = max_i; params[1] = lambda; params[2] = level; params[3] = mode;
+            key = fc_pair_key(frame_keys[p], frame_keys[p+1], m, n, k, params, 4);
+
+            if (fc_get(&cache, key, (uint32_t) m, (uint32_t) n, &q[0],
+                    prev_valid ? &prev_key : NULL, prev_valid ? &prev_q[0] : NULL) == 0) {
+                fc_dequantize_flows(&q[0], m*n, frw + p*m*n*2, rev + p*m*n*2);
+                if (cached) cached[p] = 1;
+                prev_depth = fc_find(&cache, key)->depth;
+                prev_key = key;
+                prev_q.swap(q);
+                prev_valid = 1;
+                continue;
+            }
+        }
+
+        /* frames p and p+1, converting only the ones not already held */
+        if (have[1] == (int) p) {
+            if (have[0] >= 0) free_pic(pics[0]);
+            pics[0] = pics[1];
+            have[0] = have[1];
+            have[1] = -1;
+        } else if (have[0] != (int) p) {
+            if (have[0] >= 0) free_pic(pics[0]);
+            pics[0] = pictureOf(I + p*m*n*k, n, m, k);
+            have[0] = (int) p;
+        }
+        if (have[1] != (int) p + 1) {
+            if (have[1] >= 0) free_pic(pics[1]);
+            pics[1] = pictureOf(I + (p+1)*m*n*k, n, m, k);
+            have[1] = (int) p + 1;
+        }
+
+        flows = pair_flow(pics[0], pics[1], max_i, lambda, level, mode);
+
+        /* copy flows to output MATLAB arrays */
+        flow2mat(&flows.forward, frw + p*m*n*2);
+        flow2mat(&flows.reverse, rev + p*m*n*2);
+        free_flow(flows.forward);
+        free_flow(flows.reverse);
+
+        /* store it, as a delta of the previous pair unless the chain is long enough */
+        if (use_cache) {
+            fc_quantize_flows(frw + p*m*n*2, rev + p*m*n*2, m*n, &q[0]);
+            if (!prev_valid || prev_depth + 1 >= FC_KEYFRAME) {
+                prev_valid = 0;
+                prev_depth = 0;
+            } else {
+                prev_depth++;
+            }
+            /* a pair that could not be written cannot be referenced by the next one */
+            prev_valid = (fc_put(&cache, key, (uint32_t) m, (uint32_t) n, &q[0],
+                    prev_valid ? &prev_key : NULL, prev_valid ? &prev_q[0] : NULL, prev_depth) == 0);
+            prev_key = key;
+            prev_q.swap(q);
+        }
+    }
+
+    /* deallocate stuff */
+    if (have[0] >= 0) free_pic(pics[0]);
+    if (have[1] >= 0) free_pic(pics[1]);
+
+    return;
+
+}
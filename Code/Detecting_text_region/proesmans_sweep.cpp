@@ -0,0 +1,280 @@
+/* Parameter sweep of the Proesmans optical flow over a grid of iter, lambda and level values.   */
+
+/* Tuning proesmans by calling it once per parameter combination rebuilds, every time, the same
+ * colour planes, the same half_pic pyramid and the same calc_Ex/Ey/Et gradients, none of which
+ * depend on iter or lambda. This MEX builds them once per frame pair, for the deepest level in
+ * the grid, and then runs only the iterations for each combination:
+ *  - the runs sharing lambda and level are done together: at the coarsest pyramid level the
+ *    iterations start from the same flow, so the lower iter values are prefixes of the highest
+ *    one and are snapshotted on the way instead of being recomputed. The finer levels start from
+ *    a different flow for each iter and are run separately (with level 0 there are none, and the
+ *    whole iter column costs one run of the largest iter).
+ *  - the (lambda, level) groups are distributed over all cores.
+ * The results are the same as those of proesmans(A,B,iter,lambda,level,PF,PR,0).              */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex proesmans_sweep.cpp
+ * then try it as follows:
+   iters=[10 25 50];lambdas=[1 10 30];levels=[0 2 4];        % parameter grid
+   [F,R,G]=proesmans_sweep(A,B,iters,lambdas,levels);         % all 27 combinations
+ * G has one row [iter lambda level] per combination, iter varying fastest, then lambda, then
+ * level, and F(:,:,:,g), R(:,:,:,g) are the forward and reverse flows of row g, laid out as the
+ * outputs of proesmans. An optional sixth argument sets the number of threads.               */
+
+/* basic MATLAB includes */
+#include "mex.h"
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+/* flow engine */
+#include "proesmans.h"
+
+
+/* lambda independent data of one pyramid level */
+
+struct sweep_level {
+    picture P1, P2;
+    float **Ex1, **Ey1, **Ex2, **Ey2;
+    twin_flows guess;                  /* first_guess, used when level 0 is the coarsest */
+};
+
+/* one (lambda, level) group of the grid */
+
+struct sweep_group {
+    float lambda;
+    int level;
+    std::vector<int> iters;            /* ascending */
+    std::vector<int> out;              /* grid row of each iter */
+};
+
+
+void copy_flow(flow src, flow dst) {
+    memcpy(dst.u[0], src.u[0], src.maxx*src.maxy*sizeof(float));
+    memcpy(dst.v[0], src.v[0], src.maxx*src.maxy*sizeof(float));
+}
+
+/* the iteration loop of calculate_flow, on precomputed gradients, keeping prev/next buffers */
+void iterate_flow(sweep_level *L, twin_flows *prev, twin_flows *next, int count, float lambda) {
+    float **forward_consistency, **reverse_consistency;
+    twin_flows temp;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        forward_consistency = compare(prev->forward, prev->reverse);
+        refine_flow(prev->forward, &(next->forward), L->P1, L->P2, L->Ex1, L->Ey1, lambda, forward_consistency);
+        fix_edges(&(next->forward));
+        reverse_consistency = compare(prev->reverse, prev->forward);
+        refine_flow(prev->reverse, &(next->reverse), L->P2, L->P1, L->Ex2, L->Ey2, lambda, reverse_consistency);
+        fix_edges(&(next->reverse));
+        free_float_space(forward_consistency);
+        free_float_space(reverse_consistency);
+
+        temp = *next;
+        *next = *prev;
+        *prev = temp;
+    }
+}
+
+twin_flows alloc_twin(sweep_level *L) {
+    twin_flows t;
+    t.forward = alloc_flow(L->P1.width, L->P1.height);
+    t.reverse = alloc_flow(L->P1.width, L->P1.height);
+    return t;
+}
+
+void free_twin(twin_flows t) {
+    free_flow(t.forward);
+    free_flow(t.reverse);
+}
+
+/* all the iter values of one group; results go to frw/rev at the grid rows of the group */
+void run_group(sweep_level *pyr, sweep_group *g, double *frw, double *rev, size_t plane) {
+    int top = g->level, d, k, done;
+    size_t j;
+    twin_flows prev, next, up, upnext;
+    std::vector<twin_flows> snaps;
+
+    /* coarsest level: one chain of iterations, snapshotted at each requested iter */
+    prev = alloc_twin(&pyr[top]);
+    next = alloc_twin(&pyr[top]);
+    if (top == 0) {
+        copy_flow(pyr[0].guess.forward, prev.forward);
+        copy_flow(pyr[0].guess.reverse, prev.reverse);
+    }
+    done = 0;
+    for (j = 0; j < g->iters.size(); j++) {
+        iterate_flow(&pyr[top], &prev, &next, g->iters[j] - done, g->lambda);
+        done = g->iters[j];
+        twin_flows s = alloc_twin(&pyr[top]);
+        copy_flow(prev.forward, s.forward);
+        copy_flow(prev.reverse, s.reverse);
+        snaps.push_back(s);
+    }
+    free_twin(prev);
+    free_twin(next);
+
+    /* finer levels: every iter value from its own snapshot */
+    for (j = 0; j < g->iters.size(); j++) {
+        prev = snaps[j];
+        for (d = top - 1; d >= 0; d--) {
+            up = alloc_twin(&pyr[d]);
+            upnext = alloc_twin(&pyr[d]);
+            double_flow(prev.forward, up.forward);
+            double_flow(prev.reverse, up.reverse);
+            free_twin(prev);
+            iterate_flow(&pyr[d], &up, &upnext, g->iters[j], g->lambda);
+            free_twin(upnext);
+            prev = up;
+        }
+        k = g->out[j];
+        flow2mat(&prev.forward, frw + k*plane);
+        flow2mat(&prev.reverse, rev + k*plane);
+        free_twin(prev);
+    }
+} // run_group
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    unsigned char *I1, *I2;
+    double *iters, *lambdas, *levels, *frw, *rev, *G;
+    mwSize m, n, k, ni, nl, nv, ng, g, a, b, c, nd, odims[4];
+    const mwSize *size;
+    int max_level, nthreads, t, d;
+    std::vector<sweep_level> pyr;
+    std::vector<sweep_group> groups;
+    std::vector<std::thread> pool;
+    std::atomic<size_t> next(0);
+
+    /* Check for proper number of arguments */
+    if (nrhs != 5 && nrhs != 6) {
+        mexErrMsgTxt("usage: [F,R,G]=proesmans_sweep(I1,I2,iters,lambdas,levels,nthreads);");
+    } else if (nlhs > 3) {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+
+    /* deal with INPUT parameters ************************************************************* */
+
+    if ( mxIsSparse(prhs[0]) || mxGetClassID(prhs[0])!= mxUINT8_CLASS ||
+            mxIsSparse(prhs[1]) || mxGetClassID(prhs[1])!= mxUINT8_CLASS )
+        mexErrMsgTxt("usage: [F,R,G]=proesmans_sweep(I1,I2,iters,lambdas,levels); \n I1 and I2 must be uint8");
+    if ( mxGetNumberOfElements(prhs[0]) != mxGetNumberOfElements(prhs[1]) ||
+            mxGetM(prhs[0]) != mxGetM(prhs[1]) || mxGetN(prhs[0]) != mxGetN(prhs[1]) )
+        mexErrMsgTxt("I1 & I2 must have same dimensions");
+    if ( !mxIsDouble(prhs[2]) || !mxIsDouble(prhs[3]) || !mxIsDouble(prhs[4]) )
+        mexErrMsgTxt("usage: [F,R,G]=proesmans_sweep(I1,I2,iters,lambdas,levels); \n iters, lambdas and levels must be double");
+
+    I1 = (unsigned char *) mxGetData(prhs[0]);
+    I2 = (unsigned char *) mxGetData(prhs[1]);
+    nd = mxGetNumberOfDimensions(prhs[0]);
+    size = mxGetDimensions(prhs[0]);
+    m = size[0]; n = size[1];
+    k = (nd > 2 ? size[2] : 1);
+
+    iters = mxGetPr(prhs[2]);   ni = mxGetNumberOfElements(prhs[2]);
+    lambdas = mxGetPr(prhs[3]); nl = mxGetNumberOfElements(prhs[3]);
+    levels = mxGetPr(prhs[4]);  nv = mxGetNumberOfElements(prhs[4]);
+    ng = ni*nl*nv;
+    if (ng == 0)
+        mexErrMsgTxt("proesmans_sweep: empty parameter grid");
+
+    max_level = 0;
+    for (c = 0; c < nv; c++) {
+        if (levels[c] < 0)
+            mexErrMsgTxt("proesmans_sweep: iters and levels must not be negative");
+        max_level = MAX(max_level, (int) levels[c]);
+    }
+    for (a = 0; a < ni; a++)
+        if (iters[a] < 0)
+            mexErrMsgTxt("proesmans_sweep: iters and levels must not be negative");
+    nthreads = (nrhs > 5 ? (int) mxGetScalar(prhs[5]) : (int) std::thread::hardware_concurrency());
+
+    /* deal with OUTPUT parameters ************************************************************ */
+
+    odims[0] = m; odims[1] = n; odims[2] = 2; odims[3] = ng;
+    plhs[0] = mxCreateNumericArray(4, odims, mxDOUBLE_CLASS, mxREAL);
+    plhs[1] = mxCreateNumericArray(4, odims, mxDOUBLE_CLASS, mxREAL);
+    frw = mxGetPr(plhs[0]);
+    rev = mxGetPr(plhs[1]);
+    plhs[2] = mxCreateDoubleMatrix(ng, 3, mxREAL);
+    G = mxGetPr(plhs[2]);
+
+    /* the grid, grouped by (lambda, level) with ascending iters */
+    g = 0;
+    for (c = 0; c < nv; c++)
+        for (b = 0; b < nl; b++) {
+            sweep_group grp;
+            std::vector<std::pair<int, int> > order;
+            grp.lambda = (float) lambdas[b];
+            grp.level = (int) levels[c];
+            for (a = 0; a < ni; a++, g++) {
+                G[g] = (int) iters[a];
+                G[g+ng] = lambdas[b];
+                G[g+2*ng] = grp.level;
+                order.push_back(std::make_pair((int) iters[a], (int) g));
+            }
+            std::sort(order.begin(), order.end());
+            for (a = 0; a < ni; a++) {
+                grp.iters.push_back(order[a].first);
+                grp.out.push_back(order[a].second);
+            }
+            groups.push_back(grp);
+        }
+
+    /* the lambda independent part, once: planes, pyramid, gradients, first guess */
+    pyr.resize(max_level + 1);
+    pyr[0].P1 = pictureOf(I1, n, m, k);
+    pyr[0].P2 = pictureOf(I2, n, m, k);
+    for (d = 1; d <= max_level; d++) {
+        pyr[d].P1 = half_pic(pyr[d-1].P1);
+        pyr[d].P2 = half_pic(pyr[d-1].P2);
+    }
+    for (d = 0; d <= max_level; d++) {
+        pyr[d].Ex1 = calc_Ex(pyr[d].P1);
+        pyr[d].Ey1 = calc_Ey(pyr[d].P1);
+        pyr[d].Ex2 = calc_Ex(pyr[d].P2);
+        pyr[d].Ey2 = calc_Ey(pyr[d].P2);
+    }
+    pyr[0].guess = alloc_twin(&pyr[0]);
+    {
+        float **Et1 = calc_Et(pyr[0].P1, pyr[0].P2);
+        float **Et2 = calc_Et(pyr[0].P2, pyr[0].P1);
+        first_guess(pyr[0].Ex1, pyr[0].Ey1, Et1, pyr[0].P1.width, pyr[0].P1.height, pyr[0].guess.forward);
+        first_guess(pyr[0].Ex2, pyr[0].Ey2, Et2, pyr[0].P2.width, pyr[0].P2.height, pyr[0].guess.reverse);
+        free_float_space(Et1);
+        free_float_space(Et2);
+    }
+
+    /* do the actual computations, one (lambda, level) group at a time per thread ************ */
+    if (nthreads < 1) nthreads = 1;
+    if ((size_t) nthreads > groups.size()) nthreads = (int) groups.size();
+    for (t = 0; t < nthreads; t++)
+        pool.push_back(std::thread([&]() {
+            size_t j;
+            while ((j = next++) < groups.size())
+                run_group(&pyr[0], &groups[j], frw, rev, m*n*2);
+        }));
+    for (t = 0; t < nthreads; t++) pool[t].join();
+
+    /* deallocate stuff */
+    free_twin(pyr[0].guess);
+    for (d = 0; d <= max_level; d++) {
+        free_pic(pyr[d].P1);
+        free_pic(pyr[d].P2);
+        free_float_space(pyr[d].Ex1);
+        free_float_space(pyr[d].Ey1);
+        free_float_space(pyr[d].Ex2);
+        free_float_space(pyr[d].Ey2);
+    }
+
+    return;
+
+}
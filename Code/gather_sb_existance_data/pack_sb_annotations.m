@@ -0,0 +1,32 @@
+% Packing the scorebox availability and location annotations into a single
+% binary store, so the evaluation scripts do not have to parse the JSON again
+
+clear;clc;
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                     Paths                                               %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+Path_to_annotations='..\..\ScoreBox Avialability and Location';
+Store_file='scorebox.sbx';
+
+% Compile the converter and the reader if needed
+if exist('sb_pack','file')~=3
+    mex sb_pack.cpp
+end
+if exist('sb_lookup','file')~=3
+    mex sb_lookup.cpp
+end
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                     Converting all the videos                           %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+files=dir(fullfile(Path_to_annotations,'*','Video_*.json'));
+files=fullfile({files.folder},{files.name});
+
+tic
+[nv,nr]=sb_pack(files,Store_file);
+fprintf('Packed %d videos, %d seconds in %.1f s\n',nv,nr,toc);
+
+% Quick check, the availability of video 1
+[A,B,T]=sb_lookup(Store_file,1);
+fprintf('Video 1: %d of %d seconds with scorebox\n',sum(A==1),numel(A));
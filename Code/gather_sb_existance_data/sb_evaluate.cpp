@@ -0,0 +1,258 @@
+/* Precision/recall and IoU of scorebox detections against the annotations, all videos at once. */
+
+/* Replaces the per-video loops of calculate_precision_recall.m, computer_acc.m and
+ * count_correctly_detected.m: the detector output of every video is compared second by second
+ * with the scorebox store (sb_pack.cpp, built from the ScoreBox JSON) and with the event windows
+ * of Events/VidN.json, in a single pass per video and with the videos spread over all cores.   */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex -I../Detecting_text_region sb_evaluate.cpp
+ * then try it as follows:
+   D{5}=[t(:) a(:) boxes];                     % one row [second avail Ymin Ymax Xmin Xmax]
+   [S,A]=sb_evaluate('scorebox.sbx',D,'..\..\Events',0.5);                                       */
+
+/* D is a cell array whose v-th cell holds the detections of video v (empty cells are skipped),
+ * one row per evaluated second with avail 1 if the detector found the scorebox. Seconds that
+ * are not annotated are ignored. S has one row per evaluated video and A one aggregate row:
+ *    1 video                      7 precision TP/(TP+FP)
+ *    2 seconds evaluated          8 recall    TP/(TP+FN)
+ *    3 TP                         9 mean IoU of the boxes over the TP seconds
+ *    4 FP                        10 TP seconds with IoU >= iou_thr
+ *    5 FN                        11 events overlapping the evaluated seconds
+ *    6 TN                        12 of those, events with at least one TP second inside
+ * Column 11 counts the events holding at least one evaluated (annotated) second. Precision and
+ * recall are NaN when undefined; this differs on purpose from calculate_precision_recall.m,
+ * which sets recall to 1 when nothing was detected and then every NaN to 1, so that undefined
+ * values can be told apart (and left out with nanmean).
+ * An optional fifth argument sets the number of threads (default: all cores).                */
+
+#include "mex.h"
+#include <math.h>
+#include <limits.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include "sb_store.h"
+#include "event_index.h"
+
+#define NCOLS (12)
+
+static sbx_store store;
+static char store_name[1024] = "";
+static evx_index events;
+static char events_dir[1024] = "";
+static double nan_value;
+
+static void close_all(void) {
+    if (store.base) sbx_close(&store);
+    if (events_dir[0]) evx_free(&events);
+    store_name[0] = 0;
+    events_dir[0] = 0;
+}
+
+
+/* detections of one video, as handed over by MATLAB */
+
+struct video_job {
+    int video;
+    long rows;
+    const double *det;                 /* rows x 6, column-major */
+    double *out;                       /* NCOLS results */
+};
+
+double box_iou(const double *d, long rows, long i, const int16_t *g) {
+    double h, w, inter, ad, ag;
+
+    h = fmin(d[i+3*rows], g[1]) - fmax(d[i+2*rows], g[0]) + 1;
+    w = fmin(d[i+5*rows], g[3]) - fmax(d[i+4*rows], g[2]) + 1;
+    inter = (h > 0 && w > 0 ? h*w : 0);
+    ad = (d[i+3*rows] - d[i+2*rows] + 1) * (d[i+5*rows] - d[i+4*rows] + 1);
+    ag = (double)(g[1] - g[0] + 1) * (double)(g[3] - g[2] + 1);
+    return (ad + ag - inter > 0 ? inter/(ad + ag - inter) : 0);
+}
+
+void evaluate_video(video_job *job, double iou_thr, int use_events) {
+    const double *d = job->det;
+    long rows = job->rows, i, t;
+    double tp = 0, fp = 0, fn = 0, tn = 0, iou_sum = 0, loc_ok = 0, iou, *o;
+    int16_t box[4];
+    int gt, det, k, n, hit, nev;
+    const evx_video *ev;
+    std::vector<char> event_seen, event_hit;
+    std::vector<int> buf(16);
+
+    ev = (use_events ? evx_get(&events, job->video) : NULL);
+    if (ev) {
+        event_seen.assign(ev->count, 0);
+        event_hit.assign(ev->count, 0);
+    }
+
+    for (i = 0; i < rows; i++) {
+        t = (long) d[i];
+        gt = sbx_lookup(&store, job->video, t, box);
+        if (gt < 0) continue;
+        det = (d[i+rows] > 0.5);
+
+        /* mark the events this second falls into */
+        n = 0;
+        if (ev) {
+            n = evx_overlap(&events, job->video, t, t, &buf[0], (int) buf.size());
+            if (n > (int) buf.size()) {
+                buf.resize(n);
+                n = evx_overlap(&events, job->video, t, t, &buf[0], n);
+            }
+            for (k = 0; k < n; k++) event_seen[buf[k]] = 1;
+        }
+
+        if (det && gt) {
+            tp++;
+            iou = box_iou(d, rows, i, box);
+            iou_sum += iou;
+            if (iou >= iou_thr) loc_ok++;
+            for (k = 0; k < n; k++) event_hit[buf[k]] = 1;
+        } else if (det) {
+            fp++;
+        } else if (gt) {
+            fn++;
+        } else {
+            tn++;
+        }
+    }
+
+    /* events holding an evaluated second and how many of them were hit */
+    nev = hit = 0;
+    if (ev) {
+        for (k = 0; k < ev->count; k++) {
+            nev += event_seen[k];
+            hit += event_hit[k];
+        }
+    }
+
+    o = job->out;
+    o[0] = job->video;
+    o[1] = tp + fp + fn + tn;
+    o[2] = tp; o[3] = fp; o[4] = fn; o[5] = tn;
+    o[6] = (tp + fp > 0 ? tp/(tp + fp) : nan_value);
+    o[7] = (tp + fn > 0 ? tp/(tp + fn) : nan_value);
+    o[8] = (tp > 0 ? iou_sum/tp : nan_value);
+    o[9] = loc_ok;
+    o[10] = nev;
+    o[11] = hit;
+} // evaluate_video
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    char *name;
+    const mxArray *c;
+    std::vector<video_job> jobs;
+    std::vector<double> results;
+    std::vector<std::thread> pool;
+    std::atomic<size_t> next(0);
+    double iou_thr, *S, *A, iou_w;
+    int use_events, nthreads, j, col;
+    size_t nv, i;
+
+    /* Check for proper number of arguments */
+    if (nrhs < 3 || nrhs > 5) {
+        mexErrMsgTxt("usage: [S,A]=sb_evaluate(store_file,D,events_dir,iou_thr,nthreads);");
+    } else if (nlhs > 2) {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    if (!mxIsChar(prhs[0]) || !mxIsCell(prhs[1]))
+        mexErrMsgTxt("usage: [S,A]=sb_evaluate(store_file,D,events_dir,iou_thr,nthreads); \n D must be a cell array, one cell per video");
+
+    /* (re)open the annotations, they stay loaded between calls */
+    name = mxArrayToString(prhs[0]);
+    if (!store.base || strcmp(name, store_name) != 0) {
+        if (store.base) sbx_close(&store);
+        store_name[0] = 0;
+        if (sbx_open(name, &store) != 0) {
+            mxFree(name);
+            mexErrMsgTxt("sb_evaluate: cannot open store file or it is not a valid .sbx file");
+        }
+        strncpy(store_name, name, sizeof(store_name)-1);
+        mexAtExit(close_all);
+    }
+    mxFree(name);
+
+    use_events = (mxIsChar(prhs[2]) && mxGetNumberOfElements(prhs[2]) > 0);
+    if (use_events) {
+        name = mxArrayToString(prhs[2]);
+        if (strcmp(name, events_dir) != 0) {
+            if (events_dir[0]) evx_free(&events);
+            events_dir[0] = 0;
+            if (evx_load(name, &events) == 0) {
+                evx_free(&events);
+                mxFree(name);
+                mexErrMsgTxt("sb_evaluate: no VidN.json found in events_dir");
+            }
+            strncpy(events_dir, name, sizeof(events_dir)-1);
+            mexAtExit(close_all);
+        }
+        mxFree(name);
+    }
+
+    nan_value = mxGetNaN();
+    iou_thr = (nrhs > 3 ? mxGetScalar(prhs[3]) : 0.5);
+    nthreads = (nrhs > 4 ? (int) mxGetScalar(prhs[4]) : (int) std::thread::hardware_concurrency());
+    if (nthreads < 1) nthreads = 1;
+
+    /* collect the detections, the MATLAB API is only used from this thread */
+    nv = mxGetNumberOfElements(prhs[1]);
+    for (i = 0; i < nv; i++) {
+        c = mxGetCell(prhs[1], i);
+        if (!c || mxIsEmpty(c)) continue;
+        if (!mxIsDouble(c) || mxGetN(c) < 6)
+            mexErrMsgTxt("sb_evaluate: each cell of D must be a double matrix [second avail Ymin Ymax Xmin Xmax]");
+        video_job job;
+        job.video = (int) i + 1;
+        job.rows = (long) mxGetM(c);
+        job.det = mxGetPr(c);
+        job.out = NULL;
+        jobs.push_back(job);
+    }
+    results.assign(jobs.size()*NCOLS, 0);
+    for (i = 0; i < jobs.size(); i++) jobs[i].out = &results[i*NCOLS];
+
+    /* do the actual computations, one video at a time per thread */
+    if ((size_t) nthreads > jobs.size()) nthreads = (int) jobs.size();
+    for (j = 0; j < nthreads; j++)
+        pool.push_back(std::thread([&]() {
+            size_t k;
+            while ((k = next++) < jobs.size())
+                evaluate_video(&jobs[k], iou_thr, use_events);
+        }));
+    for (j = 0; j < nthreads; j++) pool[j].join();
+
+    /* per video results */
+    plhs[0] = mxCreateDoubleMatrix(jobs.size(), NCOLS, mxREAL);
+    S = mxGetPr(plhs[0]);
+    for (i = 0; i < jobs.size(); i++)
+        for (col = 0; col < NCOLS; col++)
+            S[i + col*jobs.size()] = results[i*NCOLS + col];
+
+    /* aggregate over all videos from the summed counts */
+    if (nlhs > 1) {
+        plhs[1] = mxCreateDoubleMatrix(1, NCOLS, mxREAL);
+        A = mxGetPr(plhs[1]);
+        iou_w = 0;
+        for (i = 0; i < jobs.size(); i++) {
+            for (col = 1; col < NCOLS; col++)
+                if (col < 6 || col > 8) A[col] += results[i*NCOLS + col];
+            if (results[i*NCOLS + 2] > 0) iou_w += results[i*NCOLS + 8]*results[i*NCOLS + 2];
+        }
+        A[0] = 0;
+        A[6] = (A[2] + A[3] > 0 ? A[2]/(A[2] + A[3]) : nan_value);
+        A[7] = (A[2] + A[4] > 0 ? A[2]/(A[2] + A[4]) : nan_value);
+        A[8] = (A[2] > 0 ? iou_w/A[2] : nan_value);
+    }
+
+    return;
+
+}
@@ -0,0 +1,107 @@
+/* Constant time lookup of scorebox availability and location in a memory-mapped .sbx store.   */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex sb_lookup.cpp
+ * then, having built the store once with sb_pack (see pack_sb_annotations.m):
+   [A,B]=sb_lookup('scorebox.sbx',5,[60 61 62]);   % seconds 60..62 of video 5
+   [A,B,T]=sb_lookup('scorebox.sbx',5);            % every annotated second of video 5      */
+
+/* A is a column with 1 where the scorebox is available, 0 where it is not and -1 for seconds
+ * outside the annotated range. B has one row [Ymin Ymax Xmin Xmax] per second and T holds the
+ * seconds themselves. The store stays mapped between calls (and is shared by the OS between
+ * MATLAB sessions), so after the first call a lookup costs no parsing and no file reading;
+ * it is only remapped when a different file name is passed.                                   */
+
+#include "mex.h"
+#include "sb_store.h"
+
+static sbx_store store;
+static char store_name[1024] = "";
+
+static void close_store(void) {
+    if (store.base) sbx_close(&store);
+    store_name[0] = 0;
+}
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    char *name;
+    double *sec, *a, *b, *t;
+    int video, avail;
+    long first, i, n;
+    int16_t box[4];
+
+    /* Check for proper number of arguments */
+    if (nrhs < 2 || nrhs > 3) {
+        mexErrMsgTxt("usage: [A,B,T]=sb_lookup(store_file,video,seconds);");
+    } else if (nlhs > 3) {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    if (!mxIsChar(prhs[0]))
+        mexErrMsgTxt("usage: [A,B,T]=sb_lookup(store_file,video,seconds); \n store_file must be a string");
+
+    /* (re)map the store if needed */
+    name = mxArrayToString(prhs[0]);
+    if (!store.base || strcmp(name, store_name) != 0) {
+        close_store();
+        if (sbx_open(name, &store) != 0) {
+            mxFree(name);
+            mexErrMsgTxt("sb_lookup: cannot open store file or it is not a valid .sbx file");
+        }
+        strncpy(store_name, name, sizeof(store_name)-1);
+        mexAtExit(close_store);
+    }
+    mxFree(name);
+
+    video = (int) mxGetScalar(prhs[1]);
+
+    /* either the requested seconds or the whole annotated range of the video */
+    if (nrhs == 3) {
+        if (!mxIsDouble(prhs[2]))
+            mexErrMsgTxt("usage: [A,B,T]=sb_lookup(store_file,video,seconds); \n seconds must be double");
+        n = (long) mxGetNumberOfElements(prhs[2]);
+        sec = mxGetPr(prhs[2]);
+        first = 0;
+    } else {
+        n = sbx_count(&store, video);
+        sec = NULL;
+        first = (n > 0 ? store.videos[video-1].first_time : 0);
+    }
+
+    /* Create and fill the output matrices */
+    plhs[0] = mxCreateDoubleMatrix(n, 1, mxREAL);
+    a = mxGetPr(plhs[0]);
+    b = NULL;
+    t = NULL;
+    if (nlhs > 1) {
+        plhs[1] = mxCreateDoubleMatrix(n, 4, mxREAL);
+        b = mxGetPr(plhs[1]);
+    }
+    if (nlhs > 2) {
+        plhs[2] = mxCreateDoubleMatrix(n, 1, mxREAL);
+        t = mxGetPr(plhs[2]);
+    }
+
+    for (i = 0; i < n; i++) {
+        long s = (sec ? (long) sec[i] : first + i);
+        avail = sbx_lookup(&store, video, s, box);
+        a[i] = avail;
+        if (b) {
+            if (avail < 0) box[0] = box[1] = box[2] = box[3] = 0;
+            b[i+0*n] = box[0];
+            b[i+1*n] = box[1];
+            b[i+2*n] = box[2];
+            b[i+3*n] = box[3];
+        }
+        if (t) t[i] = s;
+    }
+
+    return;
+
+}
@@ -0,0 +1,289 @@
+/* Converts the per-second scorebox JSON annotations into the binary store of sb_store.h.       */
+
+/* USAGE:
+ * from the MATLAB command line, compile using the command:
+   mex sb_pack.cpp
+ * then convert the whole annotation corpus as follows (see also pack_sb_annotations.m):
+   files=dir(fullfile(root,'*','Video_*.json'));                 % all Video_N.json files
+   files=fullfile({files.folder},{files.name});                  % cell array of full paths
+   [nv,nr]=sb_pack(files,'scorebox.sbx');                        % write the store           */
+
+/* Every input file is a JSON array of records of the form
+   {"VideoNumber":["1"],"Time":"1","Availability":"No",
+    "Location":{"Ymin":"0","Ymax":"0","Xmin":"0","Xmax":"0"}}
+ * The video number is taken from the records themselves, so the files can be passed in any
+ * order. nv and nr return the number of videos and the total number of seconds written.       */
+
+#include "mex.h"
+#include <stdlib.h>
+#include <limits.h>
+#include "sb_store.h"
+
+
+/* one parsed video, dense over first_time .. first_time+count-1 */
+
+struct sb_video_data {
+    int video;
+    long first_time;
+    long count;
+    unsigned char *avail;
+    int16_t *box;
+};
+
+
+/* file and string helpers */
+
+char *read_whole_file(const char *name, long *len) {
+    FILE *f;
+    char *buf;
+
+    f = fopen(name, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = (char *) malloc(*len + 1);
+    if (buf && fread(buf, 1, *len, f) != (size_t) *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    if (buf) buf[*len] = 0;
+    return buf;
+}
+
+/* first occurrence of key in [p,end), NULL if there is none */
+const char *find_in(const char *p, const char *end, const char *key) {
+    size_t n = strlen(key);
+    for (; p + n <= end; p++)
+        if (*p == *key && memcmp(p, key, n) == 0)
+            return p;
+    return NULL;
+}
+
+/* start of the value of "key" inside [p,end), past the colon, brackets and quotes */
+const char *json_value(const char *p, const char *end, const char *key) {
+    p = find_in(p, end, key);
+    if (!p) return NULL;
+    p += strlen(key);
+    while (p < end && (*p == ':' || *p == ' ' || *p == '[' || *p == '"' ||
+            *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+    return (p < end ? p : NULL);
+}
+
+long json_long(const char *p, const char *end, const char *key, long dflt) {
+    const char *v = json_value(p, end, key);
+    return (v ? strtol(v, NULL, 10) : dflt);
+}
+
+int16_t clamp16(long v) {
+    if (v > SHRT_MAX) return SHRT_MAX;
+    if (v < SHRT_MIN) return SHRT_MIN;
+    return (int16_t) v;
+}
+
+
+/* parse one Video_N.json file into a dense per-second video */
+
+int parse_sb_json(char *buf, long len, sb_video_data *out) {
+    const char *p, *next, *end, *v;
+    const char *rec = "\"VideoNumber\"";
+    long t, n, cap, tmin, tmax, i;
+    long *times;
+    unsigned char *av;
+    int16_t *bx;
+
+    end = buf + len;
+    cap = 4096;
+    n = 0;
+    times = (long *) malloc(cap*sizeof(long));
+    av = (unsigned char *) malloc(cap);
+    bx = (int16_t *) malloc(cap*4*sizeof(int16_t));
+    out->video = 0;
+    tmin = LONG_MAX;
+    tmax = LONG_MIN;
+
+    /* every record starts with its VideoNumber key and ends where the next one starts */
+    for (p = find_in(buf, end, rec); p; p = next) {
+        next = find_in(p + 1, end, rec);
+        const char *stop = (next ? next : end);
+
+        if (n == cap) {
+            cap *= 2;
+            times = (long *) realloc(times, cap*sizeof(long));
+            av = (unsigned char *) realloc(av, cap);
+            bx = (int16_t *) realloc(bx, cap*4*sizeof(int16_t));
+        }
+        if (out->video == 0) out->video = (int) json_long(p, stop, rec, 0);
+
+        t = json_long(p, stop, "\"Time\"", -1);
+        if (t < 0) continue;
+        v = json_value(p, stop, "\"Availability\"");
+        av[n] = (v && (*v == 'Y' || *v == 'y' || *v == '1'));
+        bx[4*n+0] = clamp16(json_long(p, stop, "\"Ymin\"", 0));
+        bx[4*n+1] = clamp16(json_long(p, stop, "\"Ymax\"", 0));
+        bx[4*n+2] = clamp16(json_long(p, stop, "\"Xmin\"", 0));
+        bx[4*n+3] = clamp16(json_long(p, stop, "\"Xmax\"", 0));
+        times[n] = t;
+        if (t < tmin) tmin = t;
+        if (t > tmax) tmax = t;
+        n++;
+    }
+
+    if (n == 0 || out->video <= 0) {
+        free(times); free(av); free(bx);
+        return -1;
+    }
+
+    /* scatter the records onto a dense timeline, holes stay "not available" */
+    out->first_time = tmin;
+    out->count = tmax - tmin + 1;
+    out->avail = (unsigned char *) calloc(out->count, 1);
+    out->box = (int16_t *) calloc(out->count*4, sizeof(int16_t));
+    for (i = 0; i < n; i++) {
+        out->avail[times[i]-tmin] = av[i];
+        memcpy(&out->box[4*(times[i]-tmin)], &bx[4*i], 4*sizeof(int16_t));
+    }
+
+    free(times); free(av); free(bx);
+    return 0;
+} // parse_sb_json
+
+
+/* write all parsed videos to the .sbx file */
+
+int write_sbx(const char *name, sb_video_data *vids, int nfiles, int num_videos) {
+    sbx_header h;
+    sbx_video *index;
+    uint64_t total, r, nwords, *bits;
+    FILE *f;
+    int i, ok;
+    long k;
+
+    index = (sbx_video *) calloc(num_videos, sizeof(sbx_video));
+    total = 0;
+    for (i = 0; i < nfiles; i++) {
+        index[vids[i].video-1].count = (uint32_t) vids[i].count;
+        index[vids[i].video-1].first_time = (uint32_t) vids[i].first_time;
+    }
+    /* records are laid out in video number order */
+    for (i = 0; i < num_videos; i++) {
+        index[i].first_record = total;
+        total += index[i].count;
+    }
+
+    sbx_layout(&h, (uint32_t) num_videos, total);
+    nwords = (total + 63)/64;
+    bits = (uint64_t *) calloc(nwords ? nwords : 1, sizeof(uint64_t));
+    for (i = 0; i < nfiles; i++) {
+        r = index[vids[i].video-1].first_record;
+        for (k = 0; k < vids[i].count; k++, r++)
+            if (vids[i].avail[k]) bits[r >> 6] |= (uint64_t)1 << (r & 63);
+    }
+
+    f = fopen(name, "wb");
+    ok = (f != NULL);
+    if (ok) {
+        static const unsigned char zeros[8] = {0};
+        ok = ok && fwrite(&h, sizeof(h), 1, f) == 1;
+        ok = ok && fwrite(zeros, 1, h.index_offset - sizeof(h), f) == h.index_offset - sizeof(h);
+        ok = ok && fwrite(index, sizeof(sbx_video), num_videos, f) == (size_t) num_videos;
+        ok = ok && fseek(f, (long) h.avail_offset, SEEK_SET) == 0;
+        ok = ok && fwrite(bits, sizeof(uint64_t), nwords, f) == nwords;
+        ok = ok && fseek(f, (long) h.box_offset, SEEK_SET) == 0;
+        for (int v = 1; ok && v <= num_videos; v++)
+            for (i = 0; ok && i < nfiles; i++)
+                if (vids[i].video == v)
+                    ok = fwrite(vids[i].box, 4*sizeof(int16_t), vids[i].count, f) ==
+                            (size_t) vids[i].count;
+        ok = (fclose(f) == 0) && ok;
+    }
+
+    free(bits);
+    free(index);
+    return (ok ? 0 : -1);
+} // write_sbx
+
+
+/* *********************** ACTUAL MEX FUNCTION ************************************************ */
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+
+{
+    char *name, *out, *buf, msg[512];
+    sb_video_data *vids;
+    int nfiles, i, j, num_videos, failed;
+    long len;
+    double records;
+
+    /* Check for proper number of arguments */
+    if (nrhs != 2) {
+        mexErrMsgTxt("usage: [nv,nr]=sb_pack(files,out_file);");
+    } else if (nlhs > 2) {
+        mexErrMsgTxt("Too many output arguments.");
+    }
+    if (!(mxIsCell(prhs[0]) || mxIsChar(prhs[0])) || !mxIsChar(prhs[1]))
+        mexErrMsgTxt("usage: [nv,nr]=sb_pack(files,out_file); \n files must be a cell array of file names");
+
+    nfiles = (mxIsCell(prhs[0]) ? (int) mxGetNumberOfElements(prhs[0]) : 1);
+    vids = (sb_video_data *) calloc(nfiles, sizeof(sb_video_data));
+    num_videos = 0;
+    failed = 0;
+    msg[0] = 0;
+
+    /* parse every file */
+    for (i = 0; i < nfiles && !failed; i++) {
+        const mxArray *c = (mxIsCell(prhs[0]) ? mxGetCell(prhs[0], i) : prhs[0]);
+        name = (c && mxIsChar(c) ? mxArrayToString(c) : NULL);
+        if (!name) {
+            sprintf(msg, "sb_pack: element %d of files is not a file name", i+1);
+            failed = 1;
+            break;
+        }
+        buf = read_whole_file(name, &len);
+        if (!buf) {
+            snprintf(msg, sizeof(msg), "sb_pack: cannot read %s", name);
+            failed = 1;
+        } else if (parse_sb_json(buf, len, &vids[i]) != 0) {
+            snprintf(msg, sizeof(msg), "sb_pack: no scorebox records found in %s", name);
+            failed = 1;
+        }
+        free(buf);
+        mxFree(name);
+        if (failed) break;
+
+        for (j = 0; j < i; j++)
+            if (vids[j].video == vids[i].video) {
+                sprintf(msg, "sb_pack: video %d appears in more than one file", vids[i].video);
+                failed = 1;
+            }
+        if (vids[i].video > num_videos) num_videos = vids[i].video;
+    }
+
+    /* write the store */
+    if (!failed) {
+        out = mxArrayToString(prhs[1]);
+        if (write_sbx(out, vids, nfiles, num_videos) != 0) {
+            snprintf(msg, sizeof(msg), "sb_pack: cannot write %s", out);
+            failed = 1;
+        }
+        mxFree(out);
+    }
+
+    records = 0;
+    for (i = 0; i < nfiles; i++) {
+        records += vids[i].count;
+        free(vids[i].avail);
+        free(vids[i].box);
+    }
+    free(vids);
+    if (failed) mexErrMsgTxt(msg);
+
+    plhs[0] = mxCreateDoubleScalar(nfiles);
+    if (nlhs > 1) plhs[1] = mxCreateDoubleScalar(records);
+
+    return;
+
+}
@@ -0,0 +1,190 @@
+/* Compact binary store for the per-second scorebox annotations.                                */
+
+/* The JSON files under "ScoreBox Avialability and Location" hold one record per second of video,
+ * each one a verbose object of strings. sb_pack.cpp converts all of them into a single .sbx file
+ * with the layout below, and sb_lookup.cpp (or any other MEX including this header) maps that
+ * file read-only and answers (video, second) queries in constant time without any parsing.      */
+
+/* FILE LAYOUT (little-endian, every section starts on an 8 byte boundary):
+ *
+ *   sbx_header                       magic, version, number of video slots, section offsets
+ *   sbx_video[num_videos]            slot v-1 describes Video_v: first record, count, first second
+ *   uint64 avail[(num_records+63)/64] availability column, one bit per record
+ *   int16  box[num_records][4]        location column, Ymin Ymax Xmin Xmax per record
+ *
+ * The records of one video are dense over the seconds first_time .. first_time+count-1, so the
+ * record of (video, second) is simply first_record + (second - first_time) and the time column
+ * is implicit. Seconds missing from the JSON are stored as not available with an empty box.     */
+
+#ifndef SB_STORE_H
+#define SB_STORE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SBX_MAGIC   (0x31584253u)      /* "SBX1" read as a little-endian uint32 */
+#define SBX_VERSION (1u)
+
+
+/* on-disk structures */
+
+struct sbx_header {
+    uint32_t magic, version;
+    uint32_t num_videos;               /* number of video slots, i.e. the largest video number */
+    uint32_t reserved;
+    uint64_t num_records;              /* total records over all videos */
+    uint64_t index_offset;             /* byte offset of sbx_video[num_videos] */
+    uint64_t avail_offset;             /* byte offset of the availability bit column */
+    uint64_t box_offset;               /* byte offset of the int16 box column */
+    uint64_t pad[3];
+};
+
+struct sbx_video {
+    uint64_t first_record;             /* index of the first record of this video */
+    uint32_t count;                    /* number of records (seconds), 0 if the video is absent */
+    uint32_t first_time;               /* second of the first record */
+};
+
+
+/* mapped store */
+
+struct sbx_store {
+    const unsigned char *base;
+    size_t size;
+    const sbx_header *hdr;
+    const sbx_video *videos;
+    const uint64_t *avail;
+    const int16_t *box;
+#ifdef _WIN32
+    HANDLE file, map;
+#else
+    int fd;
+#endif
+};
+
+static inline uint64_t sbx_align8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+/* fill in the section offsets of a header for the given number of videos and records */
+static inline void sbx_layout(sbx_header *h, uint32_t num_videos, uint64_t num_records) {
+    memset(h, 0, sizeof(*h));
+    h->magic = SBX_MAGIC;
+    h->version = SBX_VERSION;
+    h->num_videos = num_videos;
+    h->num_records = num_records;
+    h->index_offset = sbx_align8(sizeof(sbx_header));
+    h->avail_offset = sbx_align8(h->index_offset + (uint64_t)num_videos*sizeof(sbx_video));
+    h->box_offset = sbx_align8(h->avail_offset + ((num_records + 63)/64)*sizeof(uint64_t));
+}
+
+static inline uint64_t sbx_file_size(const sbx_header *h) {
+    return h->box_offset + h->num_records*4*sizeof(int16_t);
+}
+
+static inline void sbx_close(sbx_store *s) {
+#ifdef _WIN32
+    if (s->base) UnmapViewOfFile(s->base);
+    if (s->map) CloseHandle(s->map);
+    if (s->file != INVALID_HANDLE_VALUE) CloseHandle(s->file);
+    s->file = INVALID_HANDLE_VALUE;
+    s->map = NULL;
+#else
+    if (s->base) munmap((void *) s->base, s->size);
+    if (s->fd >= 0) close(s->fd);
+    s->fd = -1;
+#endif
+    s->base = NULL;
+    s->size = 0;
+} // sbx_close
+
+/* map the store read-only; returns 0 on success, -1 if the file is missing or malformed */
+static inline int sbx_open(const char *path, sbx_store *s) {
+    const sbx_header *h;
+
+    memset(s, 0, sizeof(*s));
+#ifdef _WIN32
+    LARGE_INTEGER len;
+    s->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (s->file == INVALID_HANDLE_VALUE) return -1;
+    if (!GetFileSizeEx(s->file, &len) || len.QuadPart < (LONGLONG) sizeof(sbx_header)) {
+        sbx_close(s);
+        return -1;
+    }
+    s->size = (size_t) len.QuadPart;
+    s->map = CreateFileMappingA(s->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (s->map) s->base = (const unsigned char *) MapViewOfFile(s->map, FILE_MAP_READ, 0, 0, 0);
+#else
+    struct stat st;
+    s->fd = open(path, O_RDONLY);
+    if (s->fd < 0) return -1;
+    if (fstat(s->fd, &st) != 0 || st.st_size < (off_t) sizeof(sbx_header)) {
+        sbx_close(s);
+        return -1;
+    }
+    s->size = (size_t) st.st_size;
+    s->base = (const unsigned char *) mmap(NULL, s->size, PROT_READ, MAP_SHARED, s->fd, 0);
+    if (s->base == MAP_FAILED) s->base = NULL;
+#endif
+    if (!s->base) {
+        sbx_close(s);
+        return -1;
+    }
+
+    /* check that the header and every section fit inside the file */
+    h = (const sbx_header *) s->base;
+    if (h->magic != SBX_MAGIC || h->version != SBX_VERSION ||
+            h->index_offset + (uint64_t)h->num_videos*sizeof(sbx_video) > s->size ||
+            sbx_file_size(h) > s->size) {
+        sbx_close(s);
+        return -1;
+    }
+
+    s->hdr = h;
+    s->videos = (const sbx_video *) (s->base + h->index_offset);
+    s->avail = (const uint64_t *) (s->base + h->avail_offset);
+    s->box = (const int16_t *) (s->base + h->box_offset);
+
+    /* and that every video points at records that exist */
+    for (uint32_t v = 0; v < h->num_videos; v++)
+        if (s->videos[v].first_record + s->videos[v].count > h->num_records) {
+            sbx_close(s);
+            return -1;
+        }
+    return 0;
+} // sbx_open
+
+/* number of seconds stored for a video (1-based video number), 0 if it is not in the store */
+static inline uint32_t sbx_count(const sbx_store *s, int video) {
+    if (video < 1 || (uint32_t) video > s->hdr->num_videos) return 0;
+    return s->videos[video-1].count;
+}
+
+/* availability (0 or 1) of a video at a given second, -1 if the second is not in the store.
+ * box, if not NULL, receives Ymin, Ymax, Xmin, Xmax of the annotated location. */
+static inline int sbx_lookup(const sbx_store *s, int video, long second, int16_t *box) {
+    const sbx_video *v;
+    uint64_t r;
+
+    if (video < 1 || (uint32_t) video > s->hdr->num_videos) return -1;
+    v = &s->videos[video-1];
+    if (second < (long) v->first_time || second >= (long) v->first_time + (long) v->count)
+        return -1;
+
+    r = v->first_record + (uint64_t)(second - v->first_time);
+    if (box) memcpy(box, &s->box[4*r], 4*sizeof(int16_t));
+    return (int)((s->avail[r >> 6] >> (r & 63)) & 1);
+}
+
+#endif /* SB_STORE_H */